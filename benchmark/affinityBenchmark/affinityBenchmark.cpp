@@ -0,0 +1,131 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "iomanager.h"
+#include "util.h"
+#include "forTest.h"
+
+/**
+ * CPU绑定与NUMA本地分配基准
+ * 每个任务协程在第一次运行时分配并写一块缓冲区（首次访问决定页面所在节点），之后每轮遍历一遍缓冲区，
+ * 再把自己固定调度回同一个工作线程。统计每轮运行时所在CPU相对上一轮的变化次数（线程迁移），
+ * 以及运行CPU所在节点与缓冲区所在节点不同的轮数（跨节点访问），分别在不绑定和绑定CPU+NUMA本地分配时各跑一轮
+ * 用法：affinityBenchmark [线程数] [每个线程的任务数] [轮数] [缓冲区KB]
+ */
+
+static int s_threads = 2;
+static int s_tasks = 4;
+static int s_rounds = 2000;
+static int s_bufferKB = 256;
+
+struct Stats {
+    std::atomic<uint64_t> migrations {0};
+    std::atomic<uint64_t> crossNode {0};
+    std::atomic<uint64_t> checksum {0};
+};
+
+// CPU到NUMA节点的表，计时之前建好；GetCpuNumaNode每次都要遍历/sys，放在每轮里会盖过要比较的差异
+static std::vector<int> s_cpuNode;
+
+static void buildCpuNodeTable() {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    s_cpuNode.resize(cpus > 0 ? cpus : 1);
+    for (size_t cpu = 0; cpu < s_cpuNode.size(); cpu++) {
+        int node = KSC::GetCpuNumaNode(cpu);
+        s_cpuNode[cpu] = node < 0 ? 0 : node;
+    }
+}
+
+static int nodeOf(int cpu) {
+    return cpu >= 0 && (size_t)cpu < s_cpuNode.size() ? s_cpuNode[cpu] : 0;
+}
+
+static void task(Stats *stats) {
+    std::vector<uint64_t> buf(s_bufferKB * 1024 / sizeof(uint64_t));
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = i;
+    }
+    int lastCpu = sched_getcpu();
+    int homeNode = nodeOf(lastCpu);
+    int thread = KSC::GetThreadId();
+    uint64_t sum = 0;
+
+    for (int r = 0; r < s_rounds; r++) {
+        for (size_t i = 0; i < buf.size(); i += 8) {
+            sum += buf[i]++;
+        }
+        int cpu = sched_getcpu();
+        if (cpu != lastCpu) {
+            stats->migrations++;
+            lastCpu = cpu;
+        }
+        if (nodeOf(cpu) != homeNode) {
+            stats->crossNode++;
+        }
+        // 固定回本线程，协程不会在工作线程之间移动，CPU变化只可能来自内核迁移线程
+        KSC::Scheduler::GetThis()->schedule(KSC::Doroutine::GetThis(), thread);
+        KSC::Doroutine::GetThis()->yield();
+    }
+    stats->checksum += sum;
+}
+
+static void bench(const std::string &name, const KSC::SchedulerOptions &options) {
+    Stats stats;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        KSC::IOManager iom(s_threads, false, name, options);
+        for (int i = 0; i < s_threads * s_tasks; i++) {
+            iom.schedule([&stats] { task(&stats); });
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    uint64_t rounds = (uint64_t)s_threads * s_tasks * s_rounds;
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << rounds / seconds << " rounds/s"
+              << std::setw(10) << stats.migrations.load() << " migrations"
+              << std::setw(10) << stats.crossNode.load() << " cross-node" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_tasks = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_rounds = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        s_bufferKB = atoi(argv[4]);
+    }
+    KSC::setLogDisable();
+    buildCpuNodeTable();
+
+    // 绑定时依次使用进程允许的CPU
+    KSC::SchedulerOptions pinned;
+    pinned.numaLocal = true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    std::set<int> nodes;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            pinned.cpus.push_back(cpu);
+            nodes.insert(nodeOf(cpu));
+        }
+    }
+    std::cout << "threads=" << s_threads << " tasks=" << s_tasks << " rounds=" << s_rounds
+              << " buffer=" << s_bufferKB << "KB cpus=" << pinned.cpus.size() << " nodes=" << nodes.size() << std::endl;
+
+    bench("unpinned", KSC::SchedulerOptions());
+    bench("pinned", pinned);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <stdlib.h>
+
+#include "channel.h"
+#include "forTest.h"
+
+/**
+ * 通道吞吐基准
+ * ping-pong：两个协程通过两个无缓冲通道来回传递一个整数，统计每次往返的耗时，分别在关闭和开启LIFO槽位（setRunNext）时测试
+ * fan-in：多个生产者向同一个有界通道发送，一个消费者接收，分别测试逐个收发和批量收发
+ * 用法：channelBenchmark [线程数] [消息数] [生产者数] [通道容量]
+ */
+
+static int s_threads = 2;
+static int s_messages = 200000;
+static int s_producers = 4;
+static int s_capacity = 128;
+static const int BATCH = 32;
+
+static void report(const std::string &name, std::chrono::steady_clock::time_point begin, uint64_t ops) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+              << (double)ns / ops << " ns/op" << std::setw(12) << (uint64_t)(ops * 1e9 / ns) << " ops/s" << std::endl;
+}
+
+static void benchPingPong(bool runNext) {
+    auto ping = std::make_shared<KSC::Channel<int>>();
+    auto pong = std::make_shared<KSC::Channel<int>>();
+    auto begin = std::chrono::steady_clock::now();
+    {
+        KSC::IOManager iom(s_threads, false);
+        iom.setRunNext(runNext);
+        iom.schedule([ping, pong] {
+            int val;
+            while (ping->recv(val)) {
+                pong->send(val + 1);
+            }
+        });
+        iom.schedule([ping, pong] {
+            int val = 0;
+            for (int i = 0; i < s_messages; i++) {
+                ping->send(val);
+                pong->recv(val);
+            }
+            ping->close();
+        });
+    }
+    report(runNext ? "ping-pong next" : "ping-pong", begin, s_messages);
+}
+
+static void benchFanIn(bool batch) {
+    auto ch = std::make_shared<KSC::Channel<int>>(s_capacity);
+    auto done = std::make_shared<KSC::Channel<int>>(KSC::Channel<int>::UNBOUNDED);
+    int perProducer = s_messages / s_producers;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        KSC::IOManager iom(s_threads, false);
+        for (int p = 0; p < s_producers; p++) {
+            iom.schedule([ch, done, perProducer, batch] {
+                if (batch) {
+                    int vals[BATCH];
+                    for (int i = 0; i < perProducer; i += BATCH) {
+                        int n = std::min(BATCH, perProducer - i);
+                        for (int j = 0; j < n; j++) {
+                            vals[j] = i + j;
+                        }
+                        ch->sendN(vals, n);
+                    }
+                } else {
+                    for (int i = 0; i < perProducer; i++) {
+                        ch->send(i);
+                    }
+                }
+                done->send(1);
+            });
+        }
+        iom.schedule([ch, done] {
+            int one;
+            for (int p = 0; p < s_producers; p++) {
+                done->recv(one);
+            }
+            ch->close();
+        });
+        iom.schedule([ch, batch] {
+            if (batch) {
+                int buf[BATCH];
+                while (ch->recvN(buf, BATCH) > 0) {
+                }
+            } else {
+                int val;
+                while (ch->recv(val)) {
+                }
+            }
+        });
+    }
+    report(batch ? "fan-in batch" : "fan-in", begin, (uint64_t)perProducer * s_producers);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_messages = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_producers = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        s_capacity = atoi(argv[4]);
+    }
+    KSC::setLogDisable();
+    std::cout << "threads=" << s_threads << " messages=" << s_messages
+              << " producers=" << s_producers << " capacity=" << s_capacity << std::endl;
+
+    benchPingPong(false);
+    benchPingPong(true);
+    benchFanIn(false);
+    benchFanIn(true);
+    return 0;
+}
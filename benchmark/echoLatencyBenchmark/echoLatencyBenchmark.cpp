@@ -0,0 +1,199 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "iomanager.h"
+#include "future.h"
+#include "forTest.h"
+
+/**
+ * 回显延迟基准
+ * 服务端在IOManager里用hook后的accept/read/write做回显，每个连接一个协程；
+ * 客户端是普通线程，用阻塞socket一问一答，统计每次往返的延迟分布。
+ * 分别在关闭和开启直接恢复（setDirectResume）时各跑一轮，对比p50/p99。
+ * 同时统计每次往返的全局new次数，echoLatencyBenchmarkNoPool以KSC_OBJECT_POOL=0编译，用于对比对象池的效果
+ * 用法：echoLatencyBenchmark [线程数] [客户端数] [每个客户端的往返次数] [消息字节数]
+ */
+
+static std::atomic<uint64_t> s_news {0};
+
+void *operator new(size_t size) {
+    s_news.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static int s_threads = 2;
+static int s_clients = 4;
+static int s_rounds = 20000;
+static int s_size = 64;
+
+static void serve(int listenFd, KSC::IOManager *iom) {
+    for (int i = 0; i < s_clients; i++) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+        iom->schedule([fd] {
+            std::vector<char> buf(s_size);
+            while (true) {
+                ssize_t n = read(fd, buf.data(), buf.size());
+                if (n <= 0) {
+                    break;
+                }
+                if (write(fd, buf.data(), n) != n) {
+                    break;
+                }
+            }
+            close(fd);
+        });
+    }
+    close(listenFd);
+}
+
+static void runClient(int port, std::vector<uint64_t> &samples) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr))) {
+        perror("connect");
+        close(fd);
+        return;
+    }
+
+    std::vector<char> buf(s_size, 'x');
+    samples.reserve(s_rounds);
+    for (int i = 0; i < s_rounds; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        if (write(fd, buf.data(), buf.size()) != (ssize_t)buf.size()) {
+            break;
+        }
+        size_t got = 0;
+        while (got < buf.size()) {
+            ssize_t n = read(fd, buf.data() + got, buf.size() - got);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            got += n;
+        }
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count());
+    }
+    close(fd);
+}
+
+static void bench(bool directResume) {
+    std::vector<std::vector<uint64_t>> samples(s_clients);
+    double seconds = 0;
+    uint64_t news = 0;
+    {
+        KSC::IOManager iom(s_threads, false);
+        iom.setDirectResume(directResume);
+
+        KSC::Promise<int> portPromise;
+        KSC::Future<int> port = portPromise.getFuture();
+        iom.schedule([&iom, &portPromise] {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if (bind(fd, (const sockaddr *)&addr, sizeof(addr)) || listen(fd, 128)
+                || getsockname(fd, (sockaddr *)&addr, &len)) {
+                portPromise.setValue(-1);
+                close(fd);
+                return;
+            }
+            portPromise.setValue(ntohs(addr.sin_port));
+            serve(fd, &iom);
+        });
+        if (port.get() < 0) {
+            std::cerr << "listen failed" << std::endl;
+            exit(1);
+        }
+
+        // 客户端线程不在调度器里，hook默认关闭，读写都是普通的阻塞调用
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t newsBefore = s_news.load();
+        std::vector<std::thread> clients;
+        for (int i = 0; i < s_clients; i++) {
+            clients.emplace_back(runClient, port.get(), std::ref(samples[i]));
+        }
+        for (auto &t : clients) {
+            t.join();
+        }
+        // IOManager析构时要等idle超时退出，不计入吞吐
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        news = s_news.load() - newsBefore;
+    }
+
+    std::vector<uint64_t> all;
+    for (auto &s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    if (all.empty()) {
+        std::cout << "no samples" << std::endl;
+        return;
+    }
+    std::sort(all.begin(), all.end());
+    double sum = 0;
+    for (uint64_t ns : all) {
+        sum += ns;
+    }
+    auto pct = [&all](double p) { return all[std::min(all.size() - 1, (size_t)(all.size() * p))] / 1000.0; };
+    std::cout << std::left << std::setw(16) << (directResume ? "direct resume" : "schedule") << std::right
+              << std::fixed << std::setprecision(1)
+              << " p50 " << std::setw(8) << pct(0.50) << " us"
+              << " p99 " << std::setw(8) << pct(0.99) << " us"
+              << " mean " << std::setw(8) << sum / all.size() / 1000.0 << " us"
+              << std::setw(10) << (uint64_t)(all.size() / seconds) << " rtt/s"
+              << std::setw(8) << std::setprecision(2) << (double)news / all.size() << " new/rtt" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_clients = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_rounds = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        s_size = atoi(argv[4]);
+    }
+    KSC::setLogDisable();
+    std::cout << "pool=" << KSC_OBJECT_POOL << " threads=" << s_threads << " clients=" << s_clients
+              << " rounds=" << s_rounds << " size=" << s_size << std::endl;
+
+    bench(false);
+    bench(true);
+    return 0;
+}
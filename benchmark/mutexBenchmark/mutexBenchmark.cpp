@@ -0,0 +1,138 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <string>
+#include <stdlib.h>
+
+#include "mutex.h"
+
+/**
+ * 锁竞争微基准：多个线程反复加锁、做一小段临界区工作、解锁，统计平均每次加解锁的耗时
+ * 用法：mutexBenchmark [线程数] [每个线程的迭代次数] [临界区内的工作量]
+ */
+
+static int s_threads = 4;
+static int s_iterations = 1000000;
+static int s_work = 10;
+
+static volatile uint64_t s_shared = 0;
+
+static void doWork(int n) {
+    for (int i = 0; i < n; i++) {
+        s_shared = s_shared + 1;
+    }
+}
+
+template<class Mutex>
+static void benchLock(const std::string &name) {
+    Mutex mtx;
+    s_shared = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < s_threads; t++) {
+        threads.emplace_back([&mtx] {
+            for (int i = 0; i < s_iterations; i++) {
+                std::lock_guard<Mutex> lck(mtx);
+                doWork(s_work);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    uint64_t ops = (uint64_t)s_threads * s_iterations;
+    bool ok = s_shared == ops * s_work;
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+              << (double)ns / ops << " ns/op" << (ok ? "" : "  (WRONG RESULT)") << std::endl;
+}
+
+struct Pair {
+    uint64_t a;
+    uint64_t b;
+};
+
+// 读多写少：每个线程99%的操作是读一对值，1%是写
+static void benchSeqlock() {
+    KSC::seq_locked<Pair> val(Pair{0, 0});
+    std::atomic<bool> torn {false};
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < s_threads; t++) {
+        threads.emplace_back([&val, &torn] {
+            for (int i = 0; i < s_iterations; i++) {
+                if (i % 100 == 0) {
+                    Pair p = val.load();
+                    val.store(Pair{p.a + 1, p.a + 1});
+                } else {
+                    Pair p = val.load();
+                    if (p.a != p.b) {
+                        torn = true;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << std::left << std::setw(16) << "seq_locked" << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+              << (double)ns / ((uint64_t)s_threads * s_iterations) << " ns/op" << (torn ? "  (TORN READ)" : "") << std::endl;
+}
+
+static void benchSharedMutex() {
+    std::shared_mutex mtx;
+    Pair val {0, 0};
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < s_threads; t++) {
+        threads.emplace_back([&mtx, &val] {
+            for (int i = 0; i < s_iterations; i++) {
+                if (i % 100 == 0) {
+                    std::unique_lock<std::shared_mutex> lck(mtx);
+                    val.a++;
+                    val.b++;
+                } else {
+                    std::shared_lock<std::shared_mutex> lck(mtx);
+                    volatile uint64_t a = val.a;
+                    (void)a;
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << std::left << std::setw(16) << "shared_mutex" << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+              << (double)ns / ((uint64_t)s_threads * s_iterations) << " ns/op" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_iterations = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_work = atoi(argv[3]);
+    }
+    std::cout << "threads=" << s_threads << " iterations=" << s_iterations << " work=" << s_work << std::endl;
+
+    std::cout << "-- exclusive --" << std::endl;
+    benchLock<KSC::spin_mutex>("pthread_spin");
+    benchLock<std::mutex>("std::mutex");
+    benchLock<KSC::adaptive_mutex>("adaptive_mutex");
+    benchLock<KSC::ticket_mutex>("ticket_mutex");
+
+    std::cout << "-- read mostly (1% writes) --" << std::endl;
+    benchSharedMutex();
+    benchSeqlock();
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+
+#include "iomanager.h"
+#include "future.h"
+#include "parallel.h"
+#include "forTest.h"
+
+/**
+ * parallelReduce扩展性基准
+ * 对一个大数组做逐元素哈希求和（模拟校验和），分别用parallelReduce（调度器上的一个协程发起，自己也参与）
+ * 和按线程数静态均分区间的std::thread各跑若干轮，线程数从1增加到maxThreads，输出每轮耗时和相对单线程的加速比。
+ * std::thread每轮都要创建和join线程，IOManager的线程在各轮之间复用
+ * 用法：parallelBenchmark [最大线程数] [数组元素数] [轮数] [块大小]
+ */
+
+static int s_maxThreads = (int)std::thread::hardware_concurrency();
+static size_t s_size = 16 * 1024 * 1024;
+static int s_rounds = 20;
+static size_t s_grain = 64 * 1024;
+
+static std::vector<uint32_t> s_data;
+
+static uint64_t checksum(size_t lo, size_t hi) {
+    uint64_t h = 0;
+    for (size_t i = lo; i < hi; i++) {
+        uint64_t x = s_data[i] * 0x9E3779B97F4A7C15ull;
+        h += x ^ (x >> 29);
+    }
+    return h;
+}
+
+static double benchScheduler(int threads, uint64_t &result) {
+    KSC::IOManager sc(threads, false, "parallel"); // 基类Scheduler的idle是忙等，空闲线程会和计算线程抢CPU
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < s_rounds; r++) {
+        result = KSC::submit(&sc, [] {
+            return KSC::parallelReduce<size_t, uint64_t>(0, s_size, s_grain, 0, checksum,
+                                                         [](uint64_t a, uint64_t b) { return a + b; });
+        }).get();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    sc.stop();
+    return seconds * 1000 / s_rounds;
+}
+
+static double benchThreads(int threads, uint64_t &result) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < s_rounds; r++) {
+        std::vector<uint64_t> partial(threads);
+        std::vector<std::thread> thrs;
+        size_t step = (s_size + threads - 1) / threads;
+        for (int t = 0; t < threads; t++) {
+            thrs.emplace_back([t, step, &partial]() {
+                size_t lo = std::min(s_size, t * step);
+                partial[t] = checksum(lo, std::min(s_size, lo + step));
+            });
+        }
+        result = 0;
+        for (int t = 0; t < threads; t++) {
+            thrs[t].join();
+            result += partial[t];
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return seconds * 1000 / s_rounds;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_maxThreads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_size = atol(argv[2]);
+    }
+    if (argc > 3) {
+        s_rounds = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        s_grain = atol(argv[4]);
+    }
+    if (s_maxThreads < 1) {
+        s_maxThreads = 1;
+    }
+    KSC::setLogDisable();
+
+    s_data.resize(s_size);
+    for (size_t i = 0; i < s_size; i++) {
+        s_data[i] = (uint32_t)(i * 2654435761u);
+    }
+    std::cout << "size=" << s_size << " rounds=" << s_rounds << " grain=" << s_grain << std::endl;
+
+    double baseScheduler = 0, baseThreads = 0;
+    for (int threads = 1; threads <= s_maxThreads; threads++) {
+        uint64_t a = 0, b = 0;
+        double scheduler = benchScheduler(threads, a);
+        double thread = benchThreads(threads, b);
+        if (threads == 1) {
+            baseScheduler = scheduler;
+            baseThreads = thread;
+        }
+        std::cout << std::right << std::fixed << std::setprecision(2)
+                  << "threads=" << std::setw(3) << threads
+                  << "  parallelReduce " << std::setw(8) << scheduler << " ms (x" << baseScheduler / scheduler << ")"
+                  << "  std::thread " << std::setw(8) << thread << " ms (x" << baseThreads / thread << ")"
+                  << (a == b ? "" : "  MISMATCH") << std::endl;
+    }
+    return 0;
+}
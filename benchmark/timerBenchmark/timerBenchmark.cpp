@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+#include "iomanager.h"
+#include "objectPool.h"
+#include "forTest.h"
+
+/**
+ * 定时器增删基准
+ * 多个协程反复添加一个1秒后到期的定时器再立即取消（模拟请求超时在请求完成时撤销），统计每对操作的延迟分布和全局new的调用次数。
+ * timerBenchmark使用对象池，timerBenchmarkNoPool以KSC_OBJECT_POOL=0编译，定时器、控制块和集合节点都走全局new
+ * 用法：timerBenchmark [线程数] [协程数] [每个协程的操作数]
+ */
+
+static std::atomic<uint64_t> s_news {0};
+
+void *operator new(size_t size) {
+    s_news.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static int s_threads = 2;
+static int s_doroutines = 8;
+static int s_ops = 50000;
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_doroutines = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_ops = atoi(argv[3]);
+    }
+    KSC::setLogDisable();
+    std::cout << "pool=" << KSC_OBJECT_POOL << " threads=" << s_threads << " doroutines=" << s_doroutines
+              << " ops=" << s_ops << std::endl;
+
+    std::vector<std::vector<uint32_t>> samples(s_doroutines, std::vector<uint32_t>(s_ops));
+    std::atomic<int> done {0};
+    uint64_t news = 0;
+    double seconds = 0;
+    {
+        KSC::IOManager iom(s_threads, false, "timer");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50)); // 等工作线程就绪
+        uint64_t newsBefore = s_news.load();
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < s_doroutines; i++) {
+            iom.schedule([&iom, &samples, &done, i] {
+                std::vector<uint32_t> &out = samples[i];
+                for (int j = 0; j < s_ops; j++) {
+                    auto begin = std::chrono::steady_clock::now();
+                    KSC::Timer::ptr timer = iom.addTimer(1000, [] {});
+                    timer->cancel();
+                    out[j] = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
+                }
+                ++done;
+            });
+        }
+        while (done < s_doroutines) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        news = s_news.load() - newsBefore;
+    }
+
+    std::vector<uint32_t> all;
+    for (auto &s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&all](double p) { return all[std::min(all.size() - 1, (size_t)(all.size() * p))]; };
+    std::cout << std::fixed << std::setprecision(2)
+              << "add+cancel p50 " << pct(0.50) << " ns, p99 " << pct(0.99) << " ns, p99.9 " << pct(0.999) << " ns, "
+              << (uint64_t)(all.size() / seconds) << " ops/s, " << (double)news / all.size() << " new/op" << std::endl;
+#if KSC_OBJECT_POOL
+    KSC::ObjectPoolStats stats = KSC::ObjectPool<KSC::Timer>::GetInstance().getStats();
+    std::cout << "timer pool: block " << stats.blockSize << "B, slabs " << stats.slabs << ", returns " << stats.returns
+              << ", reclaims " << stats.reclaims << std::endl;
+#endif
+    return 0;
+}
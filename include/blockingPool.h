@@ -0,0 +1,108 @@
+#ifndef BLOCKING_POOL_H
+#define BLOCKING_POOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <exception>
+#include <atomic>
+#include <type_traits>
+#include <errno.h>
+#include <stdint.h>
+
+#include "doroutineSync.h"
+#include "scheduler.h"
+
+namespace KSC {
+
+/**
+ * @brief 执行阻塞调用的线程池
+ * @details hook无法把普通文件的读写、fsync、open等调用变成异步的，直接在工作线程上执行会阻塞整个线程和排在它后面的协程。
+ * 这些调用交给这里的线程执行，线程按需创建，直到上限；线程上没有开启hook，执行的都是原始的系统调用
+ */
+class BlockingPool {
+public:
+    explicit BlockingPool(size_t maxThreads = 16);
+    ~BlockingPool();
+
+    void submit(std::function<void()> task);
+
+    size_t getMaxThreads() const { return m_maxThreads; }
+    size_t threadCount(); // 已创建的线程数
+    size_t busyCount(); // 正在执行任务的线程数
+    size_t queueDepth(); // 排队等待执行的任务数
+    uint64_t completed() const { return m_completed.load(std::memory_order_relaxed); } // 已完成的任务数
+
+    // 全局的阻塞线程池，offload和hook使用
+    static BlockingPool *GetInstance();
+
+    BlockingPool(const BlockingPool &other) = delete;
+    BlockingPool &operator=(const BlockingPool &other) = delete;
+
+private:
+    void work();
+
+private:
+    size_t m_maxThreads;
+    std::mutex m_mtx;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+    size_t m_idle = 0; // 正在等待任务的线程数
+    bool m_stopping = false;
+    std::atomic<uint64_t> m_completed {0};
+};
+
+/**
+ * @brief 把fn放到阻塞线程池里执行，挂起当前协程直到执行完成，返回fn的结果
+ * @details fn抛出的异常在当前协程里重新抛出，fn执行后的errno也会带回当前线程。
+ * 不在调度器的协程里时没有可以让出的东西，直接在当前线程执行
+ */
+template<class F>
+auto offload(F &&fn) -> std::invoke_result_t<F> {
+    using R = std::invoke_result_t<F>;
+    Scheduler *sc = WaitNode::CurrentScheduler();
+    if (!sc) {
+        return fn();
+    }
+
+    using Value = std::conditional_t<std::is_void<R>::value, bool, R>;
+    std::optional<Value> result;
+    std::exception_ptr error;
+    int err = 0;
+    WaitNode node;
+    node.prepare();
+    // 等待期间调度器里可能没有任何任务，要让它知道还有协程会回来，不能就此停止
+    sc->addExternalWait();
+    BlockingPool::GetInstance()->submit([&, sc]() {
+        try {
+            if constexpr (std::is_void<R>::value) {
+                fn();
+            } else {
+                result.emplace(fn());
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        err = errno;
+        node.wake();
+        sc->removeExternalWait();
+    });
+    node.park();
+
+    errno = err;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if constexpr (!std::is_void<R>::value) {
+        return std::move(*result);
+    }
+}
+
+};
+
+#endif // BLOCKING_POOL_H
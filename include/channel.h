@@ -0,0 +1,458 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+
+#include "doroutineSync.h"
+#include "iomanager.h"
+
+namespace KSC {
+
+/**
+ * 一次select的共享状态，第一个把fired从-1改成自己序号的一方负责唤醒select的调用者
+ */
+struct SelectState {
+    std::atomic<int> fired {-1};
+    bool selfFired = false; // 调用者在登记阶段自己就拿到了结果，不需要挂起
+    WaitNode node;
+};
+
+/**
+ * 通道上的等待者，slot指向发送方待发送的值或接收方存放结果的位置
+ */
+template<class T>
+struct ChannelWaiter : public WaitNode {
+    T *slot = nullptr;
+    bool ok = false; // 接收方为false表示通道已关闭，发送方为false表示值没有发出去
+    SelectState *select = nullptr;
+    int index = -1;
+
+    void notify() {
+        if (select) {
+            select->node.wake();
+        } else {
+            wake();
+        }
+    }
+};
+
+class SelectCaseBase {
+public:
+    virtual ~SelectCaseBase() = default;
+    // 已经就绪则尝试抢占select并返回true，否则挂到通道的等待队列上返回false
+    virtual bool arm(SelectState *state, int index) = 0;
+    // 从等待队列上摘下来，fired为true时把结果交给调用者
+    virtual void disarm(bool fired) = 0;
+};
+
+template<class T>
+class Channel;
+
+template<class T>
+class RecvCase : public SelectCaseBase {
+friend class Channel<T>;
+public:
+    RecvCase(Channel<T> &ch, T &out, bool *ok)
+        : m_ch(ch), m_out(out), m_ok(ok) {}
+
+    bool arm(SelectState *state, int index) override { return m_ch.armRecv(*this, state, index); }
+    void disarm(bool fired) override { m_ch.disarmRecv(*this, fired); }
+
+private:
+    Channel<T> &m_ch;
+    T &m_out;
+    bool *m_ok;
+    ChannelWaiter<T> m_waiter;
+};
+
+/**
+ * @brief 协程间的MPMC通道
+ * @details capacity为0时是无缓冲通道，发送方要等到接收方取走才返回；UNBOUNDED表示无界。
+ * 已有接收方挂起时发送方直接把值移动到接收方手里，不经过缓冲区；缓冲区满时发送方挂起，
+ * 接收方取走一个值后把队首发送方的值补进缓冲区并唤醒它。关闭后发送失败，接收方取完剩余数据后返回false。
+ * 在调度器的协程里阻塞时只挂起协程，在普通线程里阻塞时睡眠整个线程
+ */
+template<class T>
+class Channel {
+friend class RecvCase<T>;
+public:
+    using ptr = std::shared_ptr<Channel>;
+    static constexpr size_t UNBOUNDED = ~(size_t)0;
+
+    explicit Channel(size_t capacity = 0) : m_capacity(capacity) {}
+
+    /**
+     * @brief 发送一个值，缓冲区满时挂起，通道已关闭返回false
+     */
+    bool send(T value) {
+        Waiter *woken = nullptr;
+        adaptive_lock lck(m_mtx);
+        if (m_closed) {
+            return false;
+        }
+        if (deliverLocked(value, woken)) {
+            lck.unlock();
+            if (woken) {
+                woken->notify();
+            }
+            return true;
+        }
+        Waiter waiter;
+        waiter.prepare();
+        waiter.slot = &value;
+        m_sendq.push(&waiter);
+        lck.unlock();
+        waiter.park();
+        return waiter.ok;
+    }
+
+    /**
+     * @brief 不挂起地发送，成功时value被移走
+     */
+    bool trySend(T &value) {
+        Waiter *woken = nullptr;
+        adaptive_lock lck(m_mtx);
+        if (m_closed || !deliverLocked(value, woken)) {
+            return false;
+        }
+        lck.unlock();
+        if (woken) {
+            woken->notify();
+        }
+        return true;
+    }
+
+    /**
+     * @brief 接收一个值，通道为空时挂起，通道已关闭并且取空后返回false
+     */
+    bool recv(T &out) {
+        Waiter *woken = nullptr;
+        adaptive_lock lck(m_mtx);
+        if (takeLocked(out, woken)) {
+            lck.unlock();
+            if (woken) {
+                woken->notify();
+            }
+            return true;
+        }
+        if (m_closed) {
+            return false;
+        }
+        Waiter waiter;
+        waiter.prepare();
+        waiter.slot = &out;
+        m_recvq.push(&waiter);
+        lck.unlock();
+        waiter.park();
+        return waiter.ok;
+    }
+
+    bool tryRecv(T &out) {
+        Waiter *woken = nullptr;
+        adaptive_lock lck(m_mtx);
+        if (!takeLocked(out, woken)) {
+            return false;
+        }
+        lck.unlock();
+        if (woken) {
+            woken->notify();
+        }
+        return true;
+    }
+
+    /**
+     * @brief 批量发送，一次加锁尽量多发，放不下时挂起等待，返回实际发出的个数（只有通道关闭时才会少于n）
+     */
+    size_t sendN(T *values, size_t n) {
+        size_t sent = 0;
+        std::vector<Waiter *> woken;
+        while (sent < n) {
+            adaptive_lock lck(m_mtx);
+            if (m_closed) {
+                break;
+            }
+            Waiter *w = nullptr;
+            while (sent < n && deliverLocked(values[sent], w)) {
+                ++sent;
+                if (w) {
+                    woken.push_back(w);
+                    w = nullptr;
+                }
+            }
+            if (sent == n) {
+                lck.unlock();
+                notifyAll(woken);
+                break;
+            }
+            Waiter waiter;
+            waiter.prepare();
+            waiter.slot = &values[sent];
+            m_sendq.push(&waiter);
+            lck.unlock();
+            notifyAll(woken);
+            waiter.park();
+            if (!waiter.ok) {
+                break;
+            }
+            ++sent;
+        }
+        return sent;
+    }
+
+    /**
+     * @brief 批量接收，至少等到一个值后把当前能取到的最多n个一次取走，通道关闭并取空后返回0
+     */
+    size_t recvN(T *out, size_t n) {
+        if (n == 0) {
+            return 0;
+        }
+        std::vector<Waiter *> woken;
+        adaptive_lock lck(m_mtx);
+        size_t got = takeManyLocked(out, n, woken);
+        if (got == 0 && !m_closed) {
+            Waiter waiter;
+            waiter.prepare();
+            waiter.slot = &out[0];
+            m_recvq.push(&waiter);
+            lck.unlock();
+            waiter.park();
+            if (!waiter.ok) {
+                return 0;
+            }
+            lck.lock();
+            got = 1 + takeManyLocked(out + 1, n - 1, woken);
+        }
+        lck.unlock();
+        notifyAll(woken);
+        return got;
+    }
+
+    /**
+     * @brief 关闭通道，唤醒所有挂起的发送方和接收方，重复关闭无效果
+     */
+    void close() {
+        std::vector<Waiter *> woken;
+        adaptive_lock lck(m_mtx);
+        if (m_closed) {
+            return;
+        }
+        m_closed = true;
+        while (Waiter *w = popReceiver()) {
+            w->ok = false;
+            woken.push_back(w);
+        }
+        while (Waiter *w = popSender()) {
+            w->ok = false;
+            woken.push_back(w);
+        }
+        lck.unlock();
+        notifyAll(woken);
+    }
+
+    bool isClosed() const {
+        adaptive_lock lck(m_mtx);
+        return m_closed;
+    }
+
+    // 缓冲区里的数据个数
+    size_t size() const {
+        adaptive_lock lck(m_mtx);
+        return m_buffer.size();
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    /**
+     * @brief 生成select的接收分支，ok不为空时收到值置为true，通道关闭置为false
+     */
+    RecvCase<T> onRecv(T &out, bool *ok = nullptr) { return RecvCase<T>(*this, out, ok); }
+
+    Channel(const Channel &other) = delete;
+    Channel &operator=(const Channel &other) = delete;
+
+private:
+    using Waiter = ChannelWaiter<T>;
+
+    static void notifyAll(std::vector<Waiter *> &woken) {
+        for (Waiter *w : woken) {
+            w->notify();
+        }
+        woken.clear();
+    }
+
+    // 取出一个有效的接收方，select的接收方如果已经被别的分支抢先触发就丢掉
+    Waiter *popReceiver() {
+        while (WaitNode *node = m_recvq.pop()) {
+            Waiter *w = static_cast<Waiter *>(node);
+            if (w->select) {
+                int expected = -1;
+                if (!w->select->fired.compare_exchange_strong(expected, w->index, std::memory_order_acq_rel)) {
+                    continue;
+                }
+            }
+            return w;
+        }
+        return nullptr;
+    }
+
+    Waiter *popSender() {
+        return static_cast<Waiter *>(m_sendq.pop());
+    }
+
+    // 持锁把value交给接收方或放进缓冲区，woken返回需要在解锁后唤醒的接收方
+    bool deliverLocked(T &value, Waiter *&woken) {
+        if (Waiter *r = popReceiver()) {
+            *r->slot = std::move(value);
+            r->ok = true;
+            woken = r;
+            return true;
+        }
+        if (m_buffer.size() < m_capacity) {
+            m_buffer.push_back(std::move(value));
+            return true;
+        }
+        return false;
+    }
+
+    // 持锁取一个值，woken返回需要在解锁后唤醒的发送方
+    bool takeLocked(T &out, Waiter *&woken) {
+        if (!m_buffer.empty()) {
+            out = std::move(m_buffer.front());
+            m_buffer.pop_front();
+            if (Waiter *s = popSender()) {
+                m_buffer.push_back(std::move(*s->slot));
+                s->ok = true;
+                woken = s;
+            }
+            return true;
+        }
+        if (Waiter *s = popSender()) {
+            out = std::move(*s->slot);
+            s->ok = true;
+            woken = s;
+            return true;
+        }
+        return false;
+    }
+
+    size_t takeManyLocked(T *out, size_t n, std::vector<Waiter *> &woken) {
+        size_t got = 0;
+        Waiter *w = nullptr;
+        while (got < n && takeLocked(out[got], w)) {
+            ++got;
+            if (w) {
+                woken.push_back(w);
+                w = nullptr;
+            }
+        }
+        return got;
+    }
+
+    bool armRecv(RecvCase<T> &c, SelectState *state, int index) {
+        Waiter *woken = nullptr;
+        adaptive_lock lck(m_mtx);
+        if (state->fired.load(std::memory_order_acquire) >= 0) {
+            return true;
+        }
+        if (!m_buffer.empty() || !m_sendq.empty() || m_closed) {
+            int expected = -1;
+            if (!state->fired.compare_exchange_strong(expected, index, std::memory_order_acq_rel)) {
+                return true;
+            }
+            state->selfFired = true;
+            c.m_waiter.ok = takeLocked(c.m_out, woken);
+            lck.unlock();
+            if (woken) {
+                woken->notify();
+            }
+            return true;
+        }
+        c.m_waiter.select = state;
+        c.m_waiter.index = index;
+        c.m_waiter.slot = &c.m_out;
+        m_recvq.push(&c.m_waiter);
+        return false;
+    }
+
+    void disarmRecv(RecvCase<T> &c, bool fired) {
+        {
+            adaptive_lock lck(m_mtx);
+            if (c.m_waiter.queued) {
+                m_recvq.remove(&c.m_waiter);
+            }
+        }
+        if (fired && c.m_ok) {
+            *c.m_ok = c.m_waiter.ok;
+        }
+    }
+
+private:
+    mutable adaptive_mutex m_mtx; // 临界区内只有队列操作和值的移动，不会yield
+    std::deque<T> m_buffer;
+    WaitQueue m_recvq;
+    WaitQueue m_sendq;
+    size_t m_capacity;
+    bool m_closed = false;
+};
+
+constexpr uint64_t SELECT_WAIT_FOREVER = ~0ull;
+
+/**
+ * @brief 同时等待多个通道的接收分支，返回先就绪的分支序号，超时返回-1
+ * @details 例如 int i = KSC::select(100, ch1.onRecv(a), ch2.onRecv(b, &ok));
+ * 多个分支同时就绪时按参数顺序优先。timeoutMs为0时不挂起，超时依赖当前线程的IOManager定时器，
+ * 不在IOManager里调用时只能无限等待
+ */
+template<class... Cases>
+int select(uint64_t timeoutMs, Cases &&... cases) {
+    SelectCaseBase *list[] = {&cases...};
+    const int n = sizeof...(Cases);
+
+    auto state = std::make_shared<SelectState>();
+    state->node.prepare();
+
+    int armed = 0;
+    while (armed < n && !list[armed]->arm(state.get(), armed)) {
+        ++armed;
+    }
+
+    if (!state->selfFired) {
+        int expected = -1;
+        if (timeoutMs == 0 && state->fired.compare_exchange_strong(expected, n, std::memory_order_acq_rel)) {
+            state->selfFired = true;
+        }
+    }
+
+    if (!state->selfFired) {
+        // 走到这里说明已经有别人抢到或者将来会抢到fired，他们负责唤醒我们，因此必须挂起一次
+        Timer::ptr timer;
+        IOManager *iom = IOManager::GetThis();
+        if (timeoutMs != SELECT_WAIT_FOREVER && iom && state->fired.load(std::memory_order_acquire) < 0) {
+            SelectState *raw = state.get();
+            timer = iom->addConditionalTimer(timeoutMs, [raw, n]() {
+                int expected = -1;
+                if (raw->fired.compare_exchange_strong(expected, n, std::memory_order_acq_rel)) {
+                    raw->node.wake();
+                }
+            }, state);
+        }
+        state->node.park();
+        if (timer) {
+            timer->cancel();
+        }
+    }
+
+    int fired = state->fired.load(std::memory_order_acquire);
+    for (int i = 0; i < n && i <= armed; i++) {
+        list[i]->disarm(i == fired);
+    }
+    return fired == n ? -1 : fired;
+}
+
+};
+
+#endif // CHANNEL_H
@@ -3,9 +3,12 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 
 #include <ucontext.h>
 
+#include "doroutineArena.h"
+
 namespace KSC {
 
 class MallocStackAllocator {
@@ -16,6 +19,53 @@ public:
 
 using StackAllocator = MallocStackAllocator;
 
+/**
+ * @brief 协程局部变量的槽位表，由DoroutineLocal按下标访问
+ * @details 前INLINE_SLOTS个槽位直接内嵌在协程对象里，下标更大的放在按需分配的堆表中。
+ * 每个槽位记录值和它的析构函数，协程结束、reset或析构时依次析构。只由持有它的协程访问，不需要同步
+ */
+class LocalSlots {
+public:
+    static constexpr size_t INLINE_SLOTS = 8;
+
+    LocalSlots() = default;
+    ~LocalSlots() { clear(); }
+
+    void *get(size_t index) const {
+        if (index < INLINE_SLOTS) {
+            return m_inline[index].value;
+        }
+        index -= INLINE_SLOTS;
+        return index < m_overflowSize ? m_overflow[index].value : nullptr;
+    }
+
+    // 设置槽位的值，原来有值时先析构
+    void set(size_t index, void *value, void (*destroy)(void *));
+    // 析构单个槽位的值
+    void reset(size_t index) { set(index, nullptr, nullptr); }
+    // 析构所有槽位的值并释放堆表，析构函数里不应再设置协程局部变量
+    void clear();
+
+    // 分配一个新的槽位下标，下标不回收
+    static size_t AllocIndex();
+
+    LocalSlots(const LocalSlots &other) = delete;
+    LocalSlots &operator=(const LocalSlots &other) = delete;
+
+private:
+    struct Slot {
+        void *value = nullptr;
+        void (*destroy)(void *) = nullptr;
+    };
+
+    Slot *slotAt(size_t index);
+
+private:
+    Slot m_inline[INLINE_SLOTS];
+    Slot *m_overflow = nullptr;
+    size_t m_overflowSize = 0;
+};
+
 class Doroutine : public std::enable_shared_from_this<Doroutine> {
 // 协程状态
 public:
@@ -46,7 +96,21 @@ public:
     uint64_t getId() const { return m_id; }
 
 // 获取协程状态
-    State getState() const { return m_state; }
+    State getState() const { return m_state.load(std::memory_order_acquire); }
+
+// 获取最近一次resume该协程的线程id
+    int getLastThread() const { return m_lastThread.load(std::memory_order_relaxed); }
+
+// 获取协程因时间片用完被抢占让出的次数
+    uint64_t getPreemptCount() const { return m_preemptCount; }
+
+// 本协程时间片超时到检查点让出之间的延迟分布，第i个桶统计[2^i, 2^(i+1))微秒，第0个桶包括0，最后一个桶包括更大的值
+    static constexpr size_t OVERRUN_BUCKETS = 20;
+    uint64_t getOverrunCount(size_t bucket) const { return bucket < OVERRUN_BUCKETS ? m_overrunHistogram[bucket] : 0; }
+
+// 调度优先级，由调度器在指定优先级调度时记录，之后唤醒时沿用；-1表示未指定
+    int getPriority() const { return m_priority.load(std::memory_order_relaxed); }
+    void setPriority(int priority) { m_priority.store(priority, std::memory_order_relaxed); }
 
 public:
 // 设置当前线程正在运行的协程
@@ -61,14 +125,32 @@ public:
     static void WorkFunc();
 // 线程主协程初始化
     static void threadMainDoroutineInit();
+// 抢占检查点，长时间计算的循环里定期调用；当前协程的时间片已经用完时让出，排到调度器全局队列末尾，否则立即返回
+    static bool maybeYield();
+// 当前协程的局部变量槽位，线程上还没有协程时使用线程自己的槽位
+    static LocalSlots &CurrentLocals();
+// 当前协程的请求级分配器，协程结束时整体释放；不在有栈的协程里（线程主协程）时返回new_delete_resource
+    static std::pmr::memory_resource *CurrentArena();
+
+// 获取协程的请求级分配器
+    DoroutineArena &getArena() { return m_arena; }
+
+// 和栈一起分配、作为分配器第一块的内存大小
+    static constexpr size_t ARENA_INLINE_SIZE = 4096;
 
 
 private:
     uint64_t m_id = -1;
-    State m_state = READY;
+    std::atomic<State> m_state {READY}; // yield后要等上下文保存完毕回到resume里才变为READY，其他线程看到READY才能resume它
+    std::atomic<int> m_lastThread {-1}; // 最近一次运行该协程的线程，用于判断唤醒时能否留在原线程
     uint32_t m_stackSize = 0;
     void *m_stack = nullptr;
     bool m_runInScheduler = false;
+    uint64_t m_preemptCount = 0; // 只由协程自己在maybeYield里修改
+    uint64_t m_overrunHistogram[OVERRUN_BUCKETS] = {0}; // 同上
+    std::atomic<int> m_priority {-1}; // 调度优先级，取值为Scheduler::Priority；唤醒方在加调度器锁之前就会读写
+    LocalSlots m_locals; // 协程局部变量，协程结束时析构
+    DoroutineArena m_arena; // 请求级分配器，协程结束时释放
     std::function<void()> m_func;
     ucontext_t m_ctx;
 };
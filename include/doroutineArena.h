@@ -0,0 +1,64 @@
+#ifndef DOROUTINE_ARENA_H
+#define DOROUTINE_ARENA_H
+
+#include <memory_resource>
+#include <stddef.h>
+
+namespace KSC {
+
+/**
+ * @brief 协程私有的指针碰撞分配器，用于请求范围内的临时对象
+ * @details 第一块内存是和协程栈一起分配的一小段，紧挨在栈顶之后，栈溢出时向低地址增长，不会踩到它；
+ * 用完后按页向堆申请新块，块大小逐次翻倍直到MAX_CHUNK。释放单个对象什么也不做，
+ * 协程结束（WorkFunc返回）或被reset复用时一次性归还所有堆块并回到第一块的起点。
+ * 只能由所属协程使用，分配出的内存不能在协程结束后继续访问
+ */
+class DoroutineArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t MAX_CHUNK = 64 * 1024;
+
+    DoroutineArena() = default;
+    DoroutineArena(void *inlineChunk, size_t inlineSize) { setInlineChunk(inlineChunk, inlineSize); }
+    ~DoroutineArena() { release(); }
+
+    // 设置和栈一起分配的第一块，调用前arena必须为空
+    void setInlineChunk(void *chunk, size_t size);
+
+    // 归还所有堆块，回到第一块的起点
+    void release();
+
+    size_t allocated() const { return m_allocated; } // 上次release以来分配出去的字节数
+    size_t heapChunks() const { return m_heapChunks; } // 当前持有的堆块数
+
+    DoroutineArena(const DoroutineArena &other) = delete;
+    DoroutineArena &operator=(const DoroutineArena &other) = delete;
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+    // 堆块头部，块之间用单链表串起来
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    void *allocateSlow(size_t bytes, size_t alignment);
+
+private:
+    char *m_inline = nullptr;
+    size_t m_inlineSize = 0;
+    char *m_cur = nullptr;
+    char *m_end = nullptr;
+    Chunk *m_chunks = nullptr; // 最近分配的堆块在链表头
+    size_t m_nextChunkSize = PAGE_SIZE;
+    size_t m_allocated = 0;
+    size_t m_heapChunks = 0;
+};
+
+};
+
+#endif // DOROUTINE_ARENA_H
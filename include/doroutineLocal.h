@@ -0,0 +1,65 @@
+#ifndef DOROUTINE_LOCAL_H
+#define DOROUTINE_LOCAL_H
+
+#include <utility>
+
+#include "doroutine.h"
+
+namespace KSC {
+
+/**
+ * @brief 协程局部变量，值跟随协程在线程之间迁移，协程结束时析构
+ * @details 构造时从全局登记处领取一个槽位下标，之后的访问只是取当前协程的槽位表再按下标取值：
+ * 前LocalSlots::INLINE_SLOTS个key直接落在协程对象内嵌的数组里，更多的key落在按需分配的堆表里。
+ * 值在第一次get时默认构造，不在任何协程里时使用线程自己的槽位。
+ * 下标不回收，DoroutineLocal应当是静态或长期存在的对象
+ */
+template<class T>
+class DoroutineLocal {
+public:
+    DoroutineLocal() : m_index(LocalSlots::AllocIndex()) {}
+
+    // 取当前协程的值，还没有时默认构造一个
+    T &get() {
+        LocalSlots &slots = Doroutine::CurrentLocals();
+        void *value = slots.get(m_index);
+        if (!value) {
+            value = new T();
+            slots.set(m_index, value, &destroy);
+        }
+        return *(T *)value;
+    }
+
+    // 当前协程还没有设置过时返回nullptr，不会构造
+    T *peek() const { return (T *)Doroutine::CurrentLocals().get(m_index); }
+
+    void set(T value) {
+        LocalSlots &slots = Doroutine::CurrentLocals();
+        if (void *old = slots.get(m_index)) {
+            *(T *)old = std::move(value);
+        } else {
+            slots.set(m_index, new T(std::move(value)), &destroy);
+        }
+    }
+
+    // 提前析构当前协程的值
+    void reset() { Doroutine::CurrentLocals().reset(m_index); }
+
+    T &operator*() { return get(); }
+    T *operator->() { return &get(); }
+
+    size_t index() const { return m_index; }
+
+    DoroutineLocal(const DoroutineLocal &other) = delete;
+    DoroutineLocal &operator=(const DoroutineLocal &other) = delete;
+
+private:
+    static void destroy(void *value) { delete (T *)value; }
+
+private:
+    size_t m_index;
+};
+
+};
+
+#endif // DOROUTINE_LOCAL_H
@@ -0,0 +1,294 @@
+#ifndef DOROUTINE_SYNC_H
+#define DOROUTINE_SYNC_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "doroutine.h"
+#include "mutex.h"
+
+namespace KSC {
+
+class Scheduler;
+
+/**
+ * 同步原语的等待节点，分配在等待者自己的栈上，由等待队列侵入式地串起来
+ * 在调度器的协程里等待时yield让出工作线程，被唤醒时重新schedule回原调度器；
+ * 在普通线程（包括调度器所在线程的主协程）里等待时退化为futex睡眠
+ */
+struct WaitNode {
+    Doroutine::ptr doroutine; // 为空表示等待者是普通线程
+    Scheduler *scheduler = nullptr;
+    std::atomic<uint32_t> signaled {0}; // 普通线程等待时使用
+    bool queued = false; // 是否挂在某个等待队列上，由WaitQueue维护
+    WaitNode *prev = nullptr;
+    WaitNode *next = nullptr;
+
+    // 当前运行在调度器的子协程里时返回该调度器，否则返回nullptr
+    static Scheduler *CurrentScheduler();
+
+    // 记录当前的等待者，必须在入队之前调用
+    void prepare();
+    // 挂起直到被wake
+    void park();
+    // 唤醒等待者，thread不为-1时把协程固定调度到该线程，调用之后不能再访问该节点，因为等待者醒来后节点所在的栈帧随时会失效
+    void wake(int thread = -1);
+};
+
+/**
+ * 等待节点组成的双向链表，本身不加锁，由使用它的同步原语负责互斥
+ */
+class WaitQueue {
+public:
+    bool empty() const { return m_head == nullptr; }
+    size_t size() const { return m_size; }
+
+    void push(WaitNode *node);
+    WaitNode *pop();
+    void remove(WaitNode *node);
+    void swap(WaitQueue &other);
+
+private:
+    WaitNode *m_head = nullptr;
+    WaitNode *m_tail = nullptr;
+    size_t m_size = 0;
+};
+
+/**
+ * 协程互斥锁，竞争时挂起协程而不是阻塞工作线程
+ * m_count为持有者加等待者的数量，无竞争时加解锁各只有一次原子操作；
+ * 有等待者时解锁直接把锁交给队首的等待者，被唤醒的协程不需要再抢锁，避免锁护送
+ */
+class DoroutineMutex {
+public:
+    DoroutineMutex() = default;
+
+    void lock() {
+        if (m_count.fetch_add(1, std::memory_order_acquire) == 0) {
+            return;
+        }
+        lockSlow();
+    }
+
+    bool tryLock() {
+        int32_t expected = 0;
+        return m_count.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        if (m_count.fetch_sub(1, std::memory_order_release) == 1) {
+            return;
+        }
+        unlockSlow();
+    }
+
+    DoroutineMutex(const DoroutineMutex &other) = delete;
+    DoroutineMutex &operator=(const DoroutineMutex &other) = delete;
+
+private:
+    void lockSlow();
+    void unlockSlow();
+
+private:
+    std::atomic<int32_t> m_count {0};
+    ticket_mutex m_mtx; // 保护等待队列，临界区内不会yield
+    WaitQueue m_waiters;
+    uint32_t m_pendingHandoffs = 0; // 等待者已计入m_count但还没来得及入队时，解锁方把所有权先记在这里
+};
+
+using DoroutineMutexLock = ScopedLockImpl<DoroutineMutex>;
+
+/**
+ * 协程信号量，m_count小于0时其绝对值为等待者数量，notify时直接把名额交给队首的等待者
+ */
+class DoroutineSemaphore {
+public:
+    explicit DoroutineSemaphore(int32_t count = 0) : m_count(count) {}
+
+    void wait() {
+        if (m_count.fetch_sub(1, std::memory_order_acquire) > 0) {
+            return;
+        }
+        waitSlow();
+    }
+
+    bool tryWait() {
+        int32_t c = m_count.load(std::memory_order_relaxed);
+        while (c > 0) {
+            if (m_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void notify() {
+        if (m_count.fetch_add(1, std::memory_order_release) >= 0) {
+            return;
+        }
+        notifySlow();
+    }
+
+    DoroutineSemaphore(const DoroutineSemaphore &other) = delete;
+    DoroutineSemaphore &operator=(const DoroutineSemaphore &other) = delete;
+
+private:
+    void waitSlow();
+    void notifySlow();
+
+private:
+    std::atomic<int32_t> m_count;
+    ticket_mutex m_mtx;
+    WaitQueue m_waiters;
+    uint32_t m_pendingHandoffs = 0;
+};
+
+/**
+ * 协程条件变量，配合DoroutineMutex使用，允许虚假唤醒
+ */
+class DoroutineConditionVariable {
+public:
+    DoroutineConditionVariable() = default;
+
+    void wait(DoroutineMutex &mtx);
+
+    template<class Predicate>
+    void wait(DoroutineMutex &mtx, Predicate pred) {
+        while (!pred()) {
+            wait(mtx);
+        }
+    }
+
+    void notifyOne();
+    void notifyAll();
+
+    DoroutineConditionVariable(const DoroutineConditionVariable &other) = delete;
+    DoroutineConditionVariable &operator=(const DoroutineConditionVariable &other) = delete;
+
+private:
+    std::atomic<uint32_t> m_waiterCount {0}; // 没有等待者时notify不用加锁
+    ticket_mutex m_mtx;
+    WaitQueue m_waiters;
+};
+
+/**
+ * 等待一组任务全部完成，任务结束时调用done()，只有最后一个done()需要加锁唤醒等待者
+ */
+class WaitGroup {
+public:
+    static constexpr uint64_t WAIT_FOREVER = ~0ull;
+
+    explicit WaitGroup(int64_t count = 0) : m_count(count) {}
+
+    void add(int64_t n = 1) { m_count.fetch_add(n, std::memory_order_relaxed); }
+
+    void done() {
+        if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            wakeAll();
+        }
+    }
+
+    // 等待计数归零
+    void wait() { waitFor(WAIT_FOREVER); }
+
+    /**
+     * @brief 最多等待timeoutMs毫秒，计数归零返回true，超时返回false
+     * @details 超时依赖当前线程的IOManager定时器，不在IOManager里调用时只能无限等待
+     */
+    bool waitFor(uint64_t timeoutMs);
+
+    int64_t count() const { return m_count.load(std::memory_order_acquire); }
+
+    WaitGroup(const WaitGroup &other) = delete;
+    WaitGroup &operator=(const WaitGroup &other) = delete;
+
+private:
+    enum WaiterState {
+        WAITING,
+        WOKEN,
+        TIMEOUT
+    };
+
+    // 唤醒方和超时定时器谁先改掉state谁负责唤醒，带超时的等待者由定时器共享持有
+    struct Waiter : public WaitNode {
+        std::atomic<int> state {WAITING};
+    };
+
+    void wakeAll();
+
+private:
+    std::atomic<int64_t> m_count;
+    adaptive_mutex m_mtx;
+    WaitQueue m_waiters;
+};
+
+/**
+ * 协程读写锁
+ * 状态字：最高位表示写者持有，次高位表示有等待者，其余为读者数量。没有等待者时读写都只需一次CAS；
+ * 有等待者后所有状态变化都在m_mtx下进行，写者解锁优先放行所有等待的读者，最后一个读者解锁优先交给写者，
+ * 读写交替，两边都不会饿死
+ */
+class DoroutineRWMutex {
+public:
+    DoroutineRWMutex() = default;
+
+    void rdlock() {
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        if (!(s & (WRITER | WAITERS))
+                && m_state.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+            return;
+        }
+        rdlockSlow();
+    }
+
+    void wrlock() {
+        uint32_t s = 0;
+        if (m_state.compare_exchange_strong(s, WRITER, std::memory_order_acquire)) {
+            return;
+        }
+        wrlockSlow();
+    }
+
+    void unlock() {
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        if (s & WRITER) {
+            uint32_t expected = WRITER;
+            if (!m_state.compare_exchange_strong(expected, 0, std::memory_order_release)) {
+                wrunlockSlow();
+            }
+            return;
+        }
+        while (!(s & WAITERS)) {
+            if (m_state.compare_exchange_weak(s, s - 1, std::memory_order_release)) {
+                return;
+            }
+        }
+        rdunlockSlow();
+    }
+
+    DoroutineRWMutex(const DoroutineRWMutex &other) = delete;
+    DoroutineRWMutex &operator=(const DoroutineRWMutex &other) = delete;
+
+private:
+    void rdlockSlow();
+    void wrlockSlow();
+    void rdunlockSlow();
+    void wrunlockSlow();
+
+private:
+    static constexpr uint32_t WRITER = 1u << 31;
+    static constexpr uint32_t WAITERS = 1u << 30;
+    static constexpr uint32_t READERS_MASK = WAITERS - 1;
+
+    std::atomic<uint32_t> m_state {0};
+    ticket_mutex m_mtx;
+    WaitQueue m_readers;
+    WaitQueue m_writers;
+};
+
+using DoroutineReadLock = ReadScopedLockImpl<DoroutineRWMutex>;
+using DoroutineWriteLock = WriteScopedLockImpl<DoroutineRWMutex>;
+
+};
+
+#endif // DOROUTINE_SYNC_H
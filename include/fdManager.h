@@ -17,6 +17,7 @@ public:
 
     bool isInit() const { return m_isInit; }
     bool isSocket() const { return m_isSocket; }
+    bool isRegularFile() const { return m_isRegular; }
     bool isClose() const { return m_isClosed; }
 
     void setUserNonblock(bool v) { m_userNoBlock = v; }
@@ -32,6 +33,7 @@ private:
 private:
     bool m_isInit = false;        // 是否初始化
     bool m_isSocket = false;      // 是否socket
+    bool m_isRegular = false;     // 是否普通文件，读写交给阻塞线程池执行
     bool m_sysNoBlock = false;  // 是否hook非阻塞
     bool m_userNoBlock = false; // 是否用户主动设置非阻塞
     bool m_isClosed = false;      // 是否关闭
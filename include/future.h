@@ -0,0 +1,259 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <optional>
+#include <exception>
+#include <future>
+#include <functional>
+#include <type_traits>
+
+#include "scheduler.h"
+#include "doroutineSync.h"
+#include "util.h"
+
+namespace KSC {
+
+template<class T>
+class Future;
+
+template<class T>
+class Promise;
+
+/**
+ * @brief Future/Promise共享的状态，结果直接存放在状态对象里，一次make_shared即可
+ * @details 等待者的WaitNode分配在自己的栈上，单个等待者不需要额外分配内存。
+ * 完成时唤醒等待者，如果等待者属于当前线程所在的调度器，就把它固定调度到当前线程上，保持缓存局部性
+ */
+template<class T>
+class FutureState {
+public:
+    using ptr = std::shared_ptr<FutureState>;
+    using Value = std::conditional_t<std::is_void<T>::value, bool, T>;
+
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    void wait() {
+        if (isReady()) {
+            return;
+        }
+        WaitNode node;
+        node.prepare();
+        {
+            adaptive_lock lck(m_mtx);
+            if (isReady()) {
+                return;
+            }
+            m_waiters.push(&node);
+        }
+        node.park();
+    }
+
+    void setValue(Value &&value) {
+        adaptive_lock lck(m_mtx);
+        checkUnset();
+        m_value.emplace(std::move(value));
+        complete(lck);
+    }
+
+    void setException(std::exception_ptr error) {
+        adaptive_lock lck(m_mtx);
+        checkUnset();
+        m_error = error;
+        complete(lck);
+    }
+
+    /**
+     * @brief 注册完成后的回调，已经完成时直接在当前线程执行，否则在完成方的线程里执行
+     */
+    void addContinuation(std::function<void()> func) {
+        {
+            adaptive_lock lck(m_mtx);
+            if (!isReady()) {
+                m_continuations.push_back(std::move(func));
+                return;
+            }
+        }
+        func();
+    }
+
+    const Value &value() const { return *m_value; }
+    std::exception_ptr error() const { return m_error; }
+
+private:
+    void checkUnset() {
+        if (isReady()) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+    }
+
+    void complete(adaptive_lock &lck) {
+        m_ready.store(true, std::memory_order_release);
+        WaitQueue waiters;
+        waiters.swap(m_waiters);
+        std::vector<std::function<void()>> continuations;
+        continuations.swap(m_continuations);
+        lck.unlock();
+
+        // 只有当前就在该调度器的工作协程里时才固定到本线程，普通线程可能随后阻塞，不能把等待者压在它身上
+        Scheduler *sc = WaitNode::CurrentScheduler();
+        int thread = sc ? KSC::GetThreadId() : -1;
+        while (WaitNode *node = waiters.pop()) {
+            node->wake(sc && node->scheduler == sc ? thread : -1);
+        }
+        for (auto &func : continuations) {
+            func();
+        }
+    }
+
+private:
+    std::atomic<bool> m_ready {false};
+    std::optional<Value> m_value;
+    std::exception_ptr m_error;
+    adaptive_mutex m_mtx;
+    WaitQueue m_waiters;
+    std::vector<std::function<void()>> m_continuations;
+};
+
+template<class F, class T>
+struct FutureThenResult {
+    using type = std::invoke_result_t<F, const T &>;
+};
+
+template<class F>
+struct FutureThenResult<F, void> {
+    using type = std::invoke_result_t<F>;
+};
+
+/**
+ * @brief 异步结果，可以拷贝，多个协程可以同时等待同一个结果
+ * @details 在调度器的协程里get()只挂起当前协程，在普通线程里则阻塞线程
+ */
+template<class T>
+class Future {
+friend class Promise<T>;
+template<class U> friend class Future;
+public:
+    Future() = default;
+
+    bool valid() const { return m_state != nullptr; }
+    bool isReady() const { return m_state->isReady(); }
+    void wait() const { m_state->wait(); }
+
+    /**
+     * @brief 等待并取得结果，结果为异常时重新抛出
+     */
+    decltype(auto) get() const {
+        m_state->wait();
+        if (m_state->error()) {
+            std::rethrow_exception(m_state->error());
+        }
+        if constexpr (!std::is_void<T>::value) {
+            return (const T &)m_state->value();
+        }
+    }
+
+    /**
+     * @brief 注册后续操作，func以本结果为参数（void时无参数），返回值成为新Future的结果
+     * @details 本结果为异常时不调用func，异常直接传给新Future；func在完成Promise的线程里执行，不应长时间阻塞
+     */
+    template<class F>
+    Future<typename FutureThenResult<F, T>::type> then(F &&func) const {
+        using R = typename FutureThenResult<F, T>::type;
+        auto next = std::make_shared<FutureState<R>>();
+        auto state = m_state;
+        m_state->addContinuation([state, next, func = std::forward<F>(func)]() mutable {
+            if (state->error()) {
+                next->setException(state->error());
+                return;
+            }
+            try {
+                if constexpr (std::is_void<R>::value) {
+                    if constexpr (std::is_void<T>::value) {
+                        func();
+                    } else {
+                        func(state->value());
+                    }
+                    next->setValue(true);
+                } else {
+                    if constexpr (std::is_void<T>::value) {
+                        next->setValue(func());
+                    } else {
+                        next->setValue(func(state->value()));
+                    }
+                }
+            } catch (...) {
+                next->setException(std::current_exception());
+            }
+        });
+        return Future<R>(next);
+    }
+
+private:
+    explicit Future(typename FutureState<T>::ptr state) : m_state(std::move(state)) {}
+
+private:
+    typename FutureState<T>::ptr m_state;
+};
+
+/**
+ * @brief 异步结果的生产方，只能移动，销毁时仍未设置结果则以broken_promise异常完成
+ */
+template<class T>
+class Promise {
+public:
+    Promise() : m_state(std::make_shared<FutureState<T>>()) {}
+
+    ~Promise() {
+        if (m_state && !m_state->isReady()) {
+            m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+    Promise(Promise &&other) = default;
+    Promise &operator=(Promise &&other) = default;
+    Promise(const Promise &other) = delete;
+    Promise &operator=(const Promise &other) = delete;
+
+    Future<T> getFuture() const { return Future<T>(m_state); }
+
+    template<class U = T, class = std::enable_if_t<!std::is_void<U>::value>>
+    void setValue(U value) { m_state->setValue(std::move(value)); }
+
+    template<class U = T, class = std::enable_if_t<std::is_void<U>::value>>
+    void setValue() { m_state->setValue(true); }
+
+    void setException(std::exception_ptr error) { m_state->setException(error); }
+
+private:
+    typename FutureState<T>::ptr m_state;
+};
+
+/**
+ * @brief 把func调度到scheduler上执行，返回其结果的Future
+ */
+template<class F>
+auto submit(Scheduler *scheduler, F &&func) -> Future<std::invoke_result_t<F>> {
+    using R = std::invoke_result_t<F>;
+    auto promise = std::make_shared<Promise<R>>();
+    Future<R> future = promise->getFuture();
+    scheduler->schedule(std::function<void()>([promise, func = std::forward<F>(func)]() mutable {
+        try {
+            if constexpr (std::is_void<R>::value) {
+                func();
+                promise->setValue();
+            } else {
+                promise->setValue(func());
+            }
+        } catch (...) {
+            promise->setException(std::current_exception());
+        }
+    }));
+    return future;
+}
+
+};
+
+#endif // FUTURE_H
@@ -14,6 +14,21 @@ namespace KSC {
 bool isHookEnable();
 void setHookEnable(bool flag);
 
+/**
+ * @brief 在作用域内设置当前线程的hook开关，析构时恢复原来的状态，异常退出时也会恢复
+ */
+class HookEnableGuard {
+public:
+    explicit HookEnableGuard(bool flag) : m_prev(isHookEnable()) { setHookEnable(flag); }
+    ~HookEnableGuard() { setHookEnable(m_prev); }
+
+    HookEnableGuard(const HookEnableGuard &other) = delete;
+    HookEnableGuard &operator=(const HookEnableGuard &other) = delete;
+
+private:
+    bool m_prev;
+};
+
 };
 
 
@@ -73,6 +88,19 @@ extern sendmsg_fun sendmsg_f;
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
 
+//file
+typedef int (*open_fun)(const char *pathname, int flags, ...);
+extern open_fun open_f;
+
+typedef ssize_t (*pread_fun)(int fd, void *buf, size_t count, off_t offset);
+extern pread_fun pread_f;
+
+typedef ssize_t (*pwrite_fun)(int fd, const void *buf, size_t count, off_t offset);
+extern pwrite_fun pwrite_f;
+
+typedef int (*fsync_fun)(int fd);
+extern fsync_fun fsync_f;
+
 //
 typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */ );
 extern fcntl_fun fcntl_f;
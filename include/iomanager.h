@@ -20,7 +20,7 @@ public:
     };
 
 private:
-    struct FdContext {
+    struct FdContext : public PoolObject<FdContext> {
         struct EventContext {
             Scheduler *scheduler = nullptr;
             Doroutine::ptr doroutine = nullptr;
@@ -41,7 +41,8 @@ private:
     friend class FdContext;
 
 public:
-    IOManager(size_t threads = 1, bool userCaller = true, const std::string &name = "IOManager");
+    IOManager(size_t threads = 1, bool userCaller = true, const std::string &name = "IOManager",
+              const SchedulerOptions &options = SchedulerOptions());
     ~IOManager();
 
     int addEvent(int fd, Event event, std::function<void()> func = nullptr, bool repeat = false); // 给特定标识符添加某一事件
@@ -49,6 +50,13 @@ public:
     bool cancelEvent(int fd, Event event); // 删除特定标识符的指定事件，但会在删除前触发一次回调
     bool cancelAll(int fd); // 删除特定标识符的所有事件
 
+    /**
+     * 开启后，轮询到I/O事件的工作线程如果正是等待协程上次运行的线程，就把它放进本线程的本地就绪队列直接恢复，
+     * 不再经过全局队列和其他线程，只有本地队列满了才退回全局队列
+     */
+    void setDirectResume(bool enable) { m_directResume.store(enable, std::memory_order_relaxed); }
+    bool isDirectResume() const { return m_directResume.load(std::memory_order_relaxed); }
+
     static IOManager *GetThis();
 
 protected:
@@ -67,6 +75,7 @@ private:
     int m_epfd = 0;
     int m_tickleFds[2];
     std::atomic<size_t> m_pendingEventCount = {0};
+    std::atomic<bool> m_directResume {false};
     std::shared_mutex m_rwmtx;
     std::vector<FdContext *> m_fdContexts;
 };
@@ -9,10 +9,13 @@
 #include <cstdarg>
 #include <vector>
 #include <map>
-#include <list>
+#include <atomic>
+#include <algorithm>
 
 #include "util.h"
 #include "mutex.h"
+#include "rcu.h"
+#include "objectPool.h"
 
 /**
  * @brief 获取root日志器
@@ -24,16 +27,39 @@
  */
 #define SYLAR_LOG_NAME(name) sylar::LoggerManager::GetInstance()->getLogger(name)
 
+/**
+ * @brief 编译期保留的最低日志级别（数值越大越详细），低于该级别的日志语句在编译期直接消除
+ * @details 由CMake选项SYLAR_LOG_COMPILE_LEVEL传入，未指定时保留全部级别
+ */
+#ifndef SYLAR_LOG_COMPILE_LEVEL
+#define SYLAR_LOG_COMPILE_LEVEL 700
+#endif
+
+/**
+ * @brief 判断日志级别level在logger上是否启用
+ * @details 先做编译期判断，被消除的级别连后面的运行期判断和参数求值都不会生成；
+ * 运行期判断走调用点的缓存，只在任意日志器的级别发生变化后才重新读取日志器级别
+ */
+#define SYLAR_LOG_ENABLED(logger, level) \
+    ((int)(level) <= SYLAR_LOG_COMPILE_LEVEL && [&]() { \
+        static thread_local sylar::LogSiteCache s_site; \
+        return s_site.enabled(logger, level); \
+    }())
+
+/**
+ * @brief 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件
+ */
+#define SYLAR_LOG_EVENT(logger, level) \
+    sylar::LogEventWrap(logger, KSC::MakePooledShared(new sylar::LogEvent(logger->getName(), \
+        level, __FILE__, __LINE__, KSC::GetElapsedMS() - logger->getCreateTime(), \
+        KSC::GetThreadId(), KSC::GetDoroutineId(), time(0), KSC::GetThreadName()))).getLogEvent()
+
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
- * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件
- * @todo 协程id未实现，暂时写0
+ * @details 日志未启用时走空的if分支，<<后面的参数不会求值
  */
 #define SYLAR_LOG_LEVEL(logger , level) \
-    if(level <= logger->getLevel()) \
-        sylar::LogEventWrap(logger, sylar::LogEvent::ptr(new sylar::LogEvent(logger->getName(), \
-            level, __FILE__, __LINE__, KSC::GetElapsedMS() - logger->getCreateTime(), \
-            KSC::GetThreadId(), KSC::GetDoroutineId(), time(0), KSC::GetThreadName()))).getLogEvent()->getSS()
+    if(!SYLAR_LOG_ENABLED(logger, level)) {} else SYLAR_LOG_EVENT(logger, level)->getSS()
 
 #define SYLAR_LOG_FATAL(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::FATAL)
 
@@ -53,14 +79,10 @@
 
 /**
  * @brief 使用C printf方式将日志级别level的日志写入到logger
- * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件
- * @todo 协程id未实现，暂时写0
+ * @details 日志未启用时走空的if分支，格式化参数不会求值
  */
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-    if(level <= logger->getLevel()) \
-        sylar::LogEventWrap(logger, sylar::LogEvent::ptr(new sylar::LogEvent(logger->getName(), \
-            level, __FILE__, __LINE__, KSC::GetElapsedMS() - logger->getCreateTime(), \
-            KSC::GetThreadId(), KSC::GetDoroutineId(), time(0), KSC::GetThreadName()))).getLogEvent()->printf(fmt, __VA_ARGS__)
+    if(!SYLAR_LOG_ENABLED(logger, level)) {} else SYLAR_LOG_EVENT(logger, level)->printf(fmt, __VA_ARGS__)
 
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, __VA_ARGS__)
 
@@ -78,6 +100,33 @@
 
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 
+/**
+ * @brief 按调用点采样写日志的通用实现，sampler是采样器类型，后面是采样器的构造参数
+ * @details 采样器是调用点内的静态对象，构造参数只在第一次执行时求值；
+ * 被采样器丢弃的条数会在下一条真正输出的日志开头以[suppressed N]的形式报告
+ */
+#define SYLAR_LOG_SAMPLED(logger, level, sampler, ...) \
+    if(uint64_t sylar_suppressed = 0; !(SYLAR_LOG_ENABLED(logger, level) && [&]() { \
+        static sampler s_sampler(__VA_ARGS__); \
+        return s_sampler.admit(sylar_suppressed); \
+    }())) {} else SYLAR_LOG_EVENT(logger, level)->getSS() << sylar::LogSuppressed{sylar_suppressed}
+
+/**
+ * @brief 每n次只输出第1次
+ */
+#define SYLAR_LOG_EVERY_N(logger, level, n) SYLAR_LOG_SAMPLED(logger, level, sylar::LogEveryN, n)
+
+/**
+ * @brief 只输出前n次
+ */
+#define SYLAR_LOG_FIRST_N(logger, level, n) SYLAR_LOG_SAMPLED(logger, level, sylar::LogFirstN, n)
+
+/**
+ * @brief 令牌桶限流，平均每秒最多rate条，最多允许burst条突发
+ */
+#define SYLAR_LOG_RATE_LIMITED(logger, level, rate, burst) \
+    SYLAR_LOG_SAMPLED(logger, level, sylar::LogRateLimiter, rate, burst)
+
 namespace sylar {
 
 /**
@@ -128,7 +177,7 @@ public:
 /**
  * @brief 日志事件
  */
-class LogEvent {
+class LogEvent : public KSC::PoolObject<LogEvent> {
 public:
     using ptr = std::shared_ptr<LogEvent>;
     /**
@@ -347,7 +396,8 @@ public:
     void setFormatter(LogFormatter::ptr val);
 
     /**
-     * @brief 获取日志格式器
+     * @brief 获取日志格式器，未设置时返回默认日志格式器
+     * @details 格式器以快照形式发布，读取时不加锁
      */
     LogFormatter::ptr getFormatter();
 
@@ -357,10 +407,10 @@ public:
     virtual void log(LogEvent::ptr event) = 0;
 
 protected:
-    /// Mutex
-    KSC::spin_mutex m_mutex;
-    /// 日志格式器
-    LogFormatter::ptr m_formatter;
+    /// Mutex，文件类appender持锁写入，锁竞争时先自旋再睡眠
+    KSC::adaptive_mutex m_mutex;
+    /// 当前生效的日志格式器
+    KSC::RcuPtr<LogFormatter::ptr> m_formatter;
     /// 默认日志格式器
     LogFormatter::ptr m_defaultFormatter;
 };
@@ -417,6 +467,94 @@ private:
     bool m_reopenError = false;
 };
 
+/**
+ * @brief 按大小/时间滚动的文件Appender
+ * @details 当前段文件用fallocate预分配到段大小后mmap到内存，写日志只是一次memcpy，热路径上没有open/close和write系统调用。
+ * 段写满或超过滚动周期时关闭当前段（截断到实际长度），历史段依次改名为file.1、file.2...，超出保留数量的最老段直接删除。
+ * 除了滚动之外，只有在调用requestReopen()之后才会重新打开文件（例如配合logrotate在SIGHUP中调用）
+ */
+class RotatingFileLogAppender : public LogAppender {
+public:
+    using ptr = std::shared_ptr<RotatingFileLogAppender>;
+
+    /**
+     * @brief 构造函数
+     * @param[in] file 日志文件路径
+     * @param[in] max_size 单个段文件的最大字节数，会向上对齐到页大小
+     * @param[in] interval 按时间滚动的周期（秒），为0表示不按时间滚动
+     * @param[in] retention 保留的历史段数量，为0表示滚动时直接丢弃当前段
+     */
+    RotatingFileLogAppender(const std::string &file, size_t max_size = 64 * 1024 * 1024
+        , uint64_t interval = 0, size_t retention = 8);
+
+    /**
+     * @brief 析构函数，把当前段截断到实际长度后关闭
+     */
+    ~RotatingFileLogAppender();
+
+    /**
+     * @brief 写日志
+     */
+    void log(LogEvent::ptr event) override;
+
+    /**
+     * @brief 请求在下一次写日志时重新打开文件
+     * @note 只修改一个原子标志，可以在信号处理函数中调用
+     */
+    void requestReopen() { m_reopenRequested.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief 立即滚动当前段
+     * @return 新段打开成功返回true
+     */
+    bool rotate();
+
+private:
+    /**
+     * @brief 打开（或续写）当前段文件并完成预分配和映射
+     */
+    bool openSegment(time_t now);
+
+    /**
+     * @brief 打开当前段，失败时报告错误，并在RETRY_INTERVAL秒后由下一条日志重试
+     */
+    bool tryOpenSegment(time_t now);
+
+    /**
+     * @brief 解除映射，把文件截断到已写入长度后关闭
+     */
+    void closeSegment();
+
+    /**
+     * @brief 历史段依次后移一位，并删除超出保留数量的段
+     */
+    void shiftSegments();
+
+private:
+    /// 文件路径
+    std::string m_filename;
+    /// 段大小
+    size_t m_maxSize;
+    /// 滚动周期（秒）
+    uint64_t m_interval;
+    /// 保留的历史段数量
+    size_t m_retention;
+    /// 当前段文件描述符
+    int m_fd = -1;
+    /// 当前段映射的起始地址，文件系统不支持预分配时为空，改用pwrite写入
+    char *m_base = nullptr;
+    /// 当前段已写入的字节数
+    size_t m_offset = 0;
+    /// 当前段打开的时间
+    time_t m_openTime = 0;
+    /// 是否请求重新打开
+    std::atomic<bool> m_reopenRequested {false};
+    /// 打开失败后允许重试的时间，为0表示没有失败
+    time_t m_retryTime = 0;
+    /// 打开失败后的重试间隔（秒），同时限制错误报告的频率
+    static constexpr time_t RETRY_INTERVAL = 1;
+};
+
 /**
  * @brief 日志器类
  * @note 日志器类不带root logger
@@ -443,13 +581,17 @@ public:
 
     /**
      * @brief 设置日志级别
+     * @details 同时推进全局的级别版本号，使所有调用点缓存的启用状态失效
      */
-    void setLevel(LogLevel::Level level) { m_level = level; }
+    void setLevel(LogLevel::Level level) {
+        m_level = level;
+        s_levelGeneration.fetch_add(1, std::memory_order_release);
+    }
 
     /**
      * @brief 获取日志级别
      */
-    LogLevel::Level getLevel() const { return m_level; }
+    LogLevel::Level getLevel() const { return m_level.load(std::memory_order_relaxed); }
 
     /**
      * @brief 添加LogAppender
@@ -468,21 +610,152 @@ public:
 
     /**
      * @brief 写日志
+     * @details 在读临界区内遍历appender列表的快照，不加锁，和运行期增删appender互不阻塞
      */
     void log(LogEvent::ptr event);
+
+    /**
+     * @brief 获取全局的级别版本号，任意日志器调用setLevel都会使其加一
+     */
+    static uint64_t LevelGeneration() { return s_levelGeneration.load(std::memory_order_acquire); }
 private:
-    /// Mutex
-    KSC::spin_mutex m_mutex;
+    /// 级别版本号，从1开始，保证零初始化的调用点缓存一定失效
+    static std::atomic<uint64_t> s_levelGeneration;
+    /// Mutex，只用于串行化appender列表的修改
+    KSC::adaptive_mutex m_mutex;
     /// 日志器名称
     std::string m_name;
     /// 日志器等级
-    LogLevel::Level m_level;
-    /// LogAppender集合
-    std::list<LogAppender::ptr> m_appenders;
+    std::atomic<LogLevel::Level> m_level;
+    /// LogAppender集合，修改时整体替换为新的快照
+    KSC::RcuPtr<std::vector<LogAppender::ptr>> m_appenders;
     /// 创建时间（毫秒）
     uint64_t m_createTime;
 };
 
+/**
+ * @brief 日志调用点缓存，配合SYLAR_LOG_ENABLED使用，每个调用点每个线程一份
+ * @details 记录上次判断时的级别版本号和日志器，两者都没变就直接返回缓存的结果，不再访问日志器
+ */
+struct LogSiteCache {
+    /// 缓存对应的级别版本号
+    uint64_t generation = 0;
+    /// 缓存对应的日志器
+    const Logger *logger = nullptr;
+    /// 缓存的启用状态
+    bool on = false;
+
+    bool enabled(const Logger::ptr &lg, LogLevel::Level level) {
+        uint64_t gen = Logger::LevelGeneration();
+        if(gen != generation || lg.get() != logger) {
+            on = level <= lg->getLevel();
+            logger = lg.get();
+            generation = gen;
+        }
+        return on;
+    }
+};
+
+/**
+ * @brief 每n次只放行1次的采样器
+ */
+class LogEveryN {
+public:
+    LogEveryN(uint64_t n) : m_n(n ? n : 1) {}
+
+    /**
+     * @brief 判断本次是否放行
+     * @param[out] suppressed 放行时返回自上次放行以来丢弃的条数
+     */
+    bool admit(uint64_t &suppressed) {
+        uint64_t count = m_count.fetch_add(1, std::memory_order_relaxed);
+        if(count % m_n) {
+            return false;
+        }
+        suppressed = count ? m_n - 1 : 0;
+        return true;
+    }
+private:
+    /// 采样间隔
+    uint64_t m_n;
+    /// 累计调用次数
+    std::atomic<uint64_t> m_count {0};
+};
+
+/**
+ * @brief 只放行前n次的采样器
+ */
+class LogFirstN {
+public:
+    LogFirstN(uint64_t n) : m_n(n) {}
+
+    bool admit(uint64_t &suppressed) {
+        return m_count.load(std::memory_order_relaxed) < m_n
+            && m_count.fetch_add(1, std::memory_order_relaxed) < m_n;
+    }
+private:
+    /// 放行次数上限
+    uint64_t m_n;
+    /// 已放行次数
+    std::atomic<uint64_t> m_count {0};
+};
+
+/**
+ * @brief 令牌桶限流器
+ * @details 用GCRA算法实现，整个桶的状态只有一个理论到达时间，放行一次只需要一次CAS，不需要加锁
+ */
+class LogRateLimiter {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] rate 每秒放行的条数
+     * @param[in] burst 允许的突发条数
+     */
+    LogRateLimiter(uint64_t rate, uint64_t burst)
+        : m_interval(1000000 / (rate ? rate : 1))
+        , m_tolerance(m_interval * (burst ? burst : 1)) {}
+
+    bool admit(uint64_t &suppressed) {
+        uint64_t now = KSC::GetElapsedUS();
+        uint64_t tat = m_tat.load(std::memory_order_relaxed);
+        while(true) {
+            uint64_t next = std::max(tat, now) + m_interval;
+            if(next > now + m_tolerance) {
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if(m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+private:
+    /// 相邻两次放行的间隔（微秒）
+    uint64_t m_interval;
+    /// 允许提前的时间，决定突发条数
+    uint64_t m_tolerance;
+    /// 理论到达时间
+    std::atomic<uint64_t> m_tat {0};
+    /// 自上次放行以来丢弃的条数
+    std::atomic<uint64_t> m_suppressed {0};
+};
+
+/**
+ * @brief 在日志内容开头报告被丢弃的条数，没有丢弃时不输出
+ */
+struct LogSuppressed {
+    uint64_t count;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const LogSuppressed &suppressed) {
+    if(suppressed.count) {
+        os << "[suppressed " << suppressed.count << "] ";
+    }
+    return os;
+}
+
 /**
  * @brief 日志事件包装器，方便宏定义，内部包含日志事件和日志器
  */
@@ -533,6 +806,7 @@ public:
 
     /**
      * @brief 获取指定名称的日志器
+     * @details 已存在的日志器直接在日志器集合的快照中查找，不加锁
      */
     Logger::ptr getLogger(const std::string &name);
 
@@ -545,10 +819,10 @@ public:
     LoggerManager& operator=(const LoggerManager& other) = delete;
 
 private:
-    /// Mutex
-    KSC::spin_mutex m_mutex;
-    /// 日志器集合
-    std::map<std::string, Logger::ptr> m_loggers;
+    /// Mutex，只用于串行化日志器的创建
+    KSC::adaptive_mutex m_mutex;
+    /// 日志器集合，创建日志器时整体替换为新的快照
+    KSC::RcuPtr<std::map<std::string, Logger::ptr>> m_loggers;
     /// root日志器
     Logger::ptr m_root;
 };
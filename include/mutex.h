@@ -2,6 +2,13 @@
 #define MUTEX_H
 
 #include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace KSC {
 
@@ -15,7 +22,7 @@ public:
     }
 
     ~ScopedLockImpl() {
-        m_mtx.unlock();
+        unlock();
     }
 
     void lock() {
@@ -37,6 +44,75 @@ private:
     bool m_locked;
 };
 
+template<class T>
+struct ReadScopedLockImpl {
+public:
+    ReadScopedLockImpl(T& mtx)
+        : m_mtx(mtx) {
+        m_mtx.rdlock();
+        m_locked = true;
+    }
+
+    ~ReadScopedLockImpl() {
+        unlock();
+    }
+
+    void unlock() {
+        if (m_locked) {
+            m_mtx.unlock();
+            m_locked = false;
+        }
+    }
+
+private:
+    T& m_mtx;
+    bool m_locked;
+};
+
+template<class T>
+struct WriteScopedLockImpl {
+public:
+    WriteScopedLockImpl(T& mtx)
+        : m_mtx(mtx) {
+        m_mtx.wrlock();
+        m_locked = true;
+    }
+
+    ~WriteScopedLockImpl() {
+        unlock();
+    }
+
+    void unlock() {
+        if (m_locked) {
+            m_mtx.unlock();
+            m_locked = false;
+        }
+    }
+
+private:
+    T& m_mtx;
+    bool m_locked;
+};
+
+// 自旋等待时降低功耗，同时让出流水线给同核的超线程
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// 如果*addr仍等于val则睡眠，直到被futex_wake唤醒（可能虚假唤醒）
+inline void futex_wait(std::atomic<uint32_t> *addr, uint32_t val) {
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+}
+
+// 唤醒最多count个等待在addr上的线程
+inline void futex_wake(std::atomic<uint32_t> *addr, int count) {
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
 class spin_mutex {
 public:
     spin_mutex() {
@@ -64,9 +140,164 @@ private:
 
 using spin_lock = ScopedLockImpl<spin_mutex>;
 
+/**
+ * 先有限次自旋，仍拿不到锁再用futex睡眠，适合临界区长短不一的场景（例如文件写入）
+ * 状态：0未加锁，1加锁且无等待者，2加锁且可能有等待者，只有状态为2时解锁才需要系统调用
+ */
+class adaptive_mutex {
+public:
+    adaptive_mutex() = default;
+
+    void lock() {
+        uint32_t c = 0;
+        if (m_state.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+            return;
+        }
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            cpu_relax();
+            c = 0;
+            if (m_state.load(std::memory_order_relaxed) == 0
+                    && m_state.compare_exchange_weak(c, 1, std::memory_order_acquire)) {
+                return;
+            }
+        }
+        c = m_state.exchange(2, std::memory_order_acquire);
+        while (c != 0) {
+            futex_wait(&m_state, 2);
+            c = m_state.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    bool try_lock() {
+        uint32_t c = 0;
+        return m_state.compare_exchange_strong(c, 1, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        if (m_state.exchange(0, std::memory_order_release) == 2) {
+            futex_wake(&m_state, 1);
+        }
+    }
+
+    adaptive_mutex(const adaptive_mutex& other) = delete;
+    adaptive_mutex& operator=(const adaptive_mutex& other) = delete;
+
+private:
+    static constexpr int SPIN_COUNT = 100;
+    std::atomic<uint32_t> m_state {0};
+};
+
+using adaptive_lock = ScopedLockImpl<adaptive_mutex>;
+
+/**
+ * 排队自旋锁，按申请顺序获得锁，适合很短并且需要公平的临界区
+ * 持锁期间不能yield协程或者做系统调用，否则后面排队的线程会一直空转
+ */
+class ticket_mutex {
+public:
+    ticket_mutex() = default;
+
+    void lock() {
+        uint32_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        for (uint32_t spins = 1; m_serving.load(std::memory_order_acquire) != ticket; spins++) {
+            // 线程数超过核数时持锁者可能被抢占，自旋一段时间后主动让出CPU
+            if (spins % YIELD_INTERVAL == 0) {
+                sched_yield();
+            } else {
+                cpu_relax();
+            }
+        }
+    }
+
+    void unlock() {
+        m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    ticket_mutex(const ticket_mutex& other) = delete;
+    ticket_mutex& operator=(const ticket_mutex& other) = delete;
+
+private:
+    static constexpr uint32_t YIELD_INTERVAL = 128;
+    std::atomic<uint32_t> m_next {0};
+    alignas(64) std::atomic<uint32_t> m_serving {0};
+};
+
+using ticket_lock = ScopedLockImpl<ticket_mutex>;
+
+/**
+ * 顺序锁，适合读多写少的小块数据：读者不写共享内存，读完检查序号，被写者打断就重读
+ * 写者之间用自旋锁串行化，序号为奇数表示正在写
+ */
+class seq_mutex {
+public:
+    seq_mutex() = default;
+
+    uint32_t read_begin() const {
+        uint32_t seq;
+        while ((seq = m_seq.load(std::memory_order_acquire)) & 1) {
+            cpu_relax();
+        }
+        return seq;
+    }
+
+    bool read_retry(uint32_t seq) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_seq.load(std::memory_order_relaxed) != seq;
+    }
+
+    void lock() {
+        m_writer.lock();
+        m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void unlock() {
+        m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        m_writer.unlock();
+    }
+
+    seq_mutex(const seq_mutex& other) = delete;
+    seq_mutex& operator=(const seq_mutex& other) = delete;
+
+private:
+    std::atomic<uint32_t> m_seq {0};
+    spin_mutex m_writer;
+};
+
+using seq_write_lock = ScopedLockImpl<seq_mutex>;
+
+/**
+ * 用顺序锁保护的可平凡拷贝的值
+ */
+template<class T>
+class seq_locked {
+public:
+    seq_locked() = default;
+    seq_locked(const T &val) { memcpy(&m_val, &val, sizeof(T)); }
+
+    T load() const {
+        T val;
+        uint32_t seq;
+        do {
+            seq = m_mtx.read_begin();
+            memcpy(&val, (const void *)&m_val, sizeof(T));
+        } while (m_mtx.read_retry(seq));
+        return val;
+    }
+
+    void store(const T &val) {
+        seq_write_lock lock(m_mtx);
+        memcpy((void *)&m_val, &val, sizeof(T));
+    }
+
+private:
+    mutable seq_mutex m_mtx;
+    T m_val {};
+};
+
 };
 
 
 
 
-#endif
\ No newline at end of file
+#endif
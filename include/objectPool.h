@@ -0,0 +1,326 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * @brief 为0时SlabPool之上的PoolAllocator和PoolObject直接使用全局new/delete，用于对比池化前后的分配次数和延迟
+ */
+#ifndef KSC_OBJECT_POOL
+#define KSC_OBJECT_POOL 1
+#endif
+
+namespace KSC {
+
+/**
+ * @brief 单个块大小的池统计
+ */
+struct ObjectPoolStats {
+    size_t blockSize = 0; // 块大小（字节）
+    uint64_t slabs = 0; // 向malloc申请的slab数
+    uint64_t returns = 0; // 线程缓存放回共享归还链表的批次数
+    uint64_t reclaims = 0; // 线程缓存从共享归还链表取回的次数
+};
+
+/**
+ * @brief 固定大小的块分配器，每个(Size, Align)一个全局实例
+ * @details 每个线程有自己的空闲链表缓存，分配和释放都只在本线程缓存里进出链表头，不加锁也没有原子操作。
+ * 缓存超过CACHE_LIMIT时把BATCH个块作为一串挂到共享的归还链表上（一次CAS），串首记录块数和下一串。
+ * 缓存为空时从归还链表取一串（一次交换取走整个链表，没有ABA问题，再把其余的串放回去），
+ * 慢路径的耗时只和串数有关，和块数无关，线程缓存也不会超过CACHE_LIMIT；归还链表为空时才向malloc申请一个slab，
+ * 按CACHE_LIMIT切成若干串，本线程留一串，其余挂到归还链表上。
+ * 所以一个线程分配、另一个线程释放的块（全局队列节点、日志事件）会经由归还链表回到分配方。
+ * 线程退出时缓存里的块全部放回归还链表；slab不归还给系统
+ */
+template<size_t Size, size_t Align = alignof(std::max_align_t)>
+class SlabPool {
+    static_assert(Align <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+    struct Block {
+        Block *next; // 同一串里的下一块，串尾为空
+        Block *nextBatch; // 归还链表里的下一串，只在串首有效
+        size_t count; // 本串的块数，只在串首有效
+    };
+
+public:
+    static constexpr size_t BLOCK_SIZE = ((Size > sizeof(Block) ? Size : sizeof(Block)) + Align - 1) / Align * Align;
+    static constexpr size_t SLAB_BYTES = BLOCK_SIZE * 64 > 64 * 1024 ? BLOCK_SIZE * 64 : 64 * 1024;
+    static constexpr size_t CACHE_LIMIT = 256; // 每个线程最多缓存的空闲块数
+    static constexpr size_t BATCH = CACHE_LIMIT / 2; // 一次放回归还链表的块数
+
+    // 永不析构，线程退出时的缓存回收可能晚于静态对象析构
+    static SlabPool &GetInstance() {
+        static SlabPool *s_instance = new SlabPool;
+        return *s_instance;
+    }
+
+    void *allocate() {
+        Cache &cache = t_cache;
+        if (Block *block = cache.head) {
+            cache.head = block->next;
+            --cache.count;
+            return block;
+        }
+        return allocateSlow();
+    }
+
+    void deallocate(void *p) {
+        Block *block = (Block *)p;
+        Cache &cache = t_cache;
+        if (cache.state != ALIVE) {
+            deallocateSlow(block);
+            return;
+        }
+        block->next = cache.head;
+        cache.head = block;
+        if (++cache.count > CACHE_LIMIT) {
+            flush(cache, BATCH);
+        }
+    }
+
+    ObjectPoolStats getStats() const {
+        ObjectPoolStats stats;
+        stats.blockSize = BLOCK_SIZE;
+        stats.slabs = m_slabs.load(std::memory_order_relaxed);
+        stats.returns = m_returns.load(std::memory_order_relaxed);
+        stats.reclaims = m_reclaims.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    enum CacheState {
+        NEW, // 还没注册线程退出时的回收
+        ALIVE,
+        DEAD // 线程正在退出，之后的释放直接放回归还链表
+    };
+
+    // 平凡类型的线程变量不需要初始化检查，访问只是一次TLS寻址
+    struct Cache {
+        Block *head = nullptr;
+        size_t count = 0;
+        int state = NEW;
+    };
+
+    // 第一次走慢路径时构造，线程退出时把缓存放回归还链表
+    struct Reclaimer {
+        Reclaimer() { t_cache.state = ALIVE; }
+        ~Reclaimer() {
+            Cache &cache = t_cache;
+            cache.state = DEAD;
+            if (cache.head) {
+                GetInstance().flush(cache, cache.count);
+            }
+        }
+    };
+
+    SlabPool() = default;
+
+    void *allocateSlow() {
+        Cache &cache = t_cache;
+        if (cache.state == NEW) {
+            (void)t_reclaimer; // 触发构造，注册线程退出回收
+        }
+        // 进入慢路径时缓存一定是空的
+        Block *batch = popBatch();
+        if (batch) {
+            m_reclaims.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            batch = newSlab();
+        }
+        Block *block = batch;
+        cache.head = block->next;
+        cache.count = batch->count - 1;
+        if (cache.state == DEAD && cache.head) {
+            // 线程退出过程中不再缓存
+            flush(cache, cache.count);
+        }
+        return block;
+    }
+
+    void deallocateSlow(Block *block) {
+        Cache &cache = t_cache;
+        if (cache.state == NEW) {
+            (void)t_reclaimer;
+            block->next = cache.head;
+            cache.head = block;
+            ++cache.count;
+            return;
+        }
+        block->next = nullptr;
+        block->count = 1;
+        pushBatches(block, block);
+        m_returns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 把缓存头部的最多n个块作为一串挂到归还链表上
+    void flush(Cache &cache, size_t n) {
+        Block *first = cache.head;
+        Block *last = first;
+        size_t count = 1;
+        for (; count < n && last->next; count++) {
+            last = last->next;
+        }
+        cache.head = last->next;
+        cache.count -= count;
+        last->next = nullptr;
+        first->count = count;
+        pushBatches(first, first);
+        m_returns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 把first到last（按nextBatch相连）的若干串挂到归还链表头部
+    void pushBatches(Block *first, Block *last) {
+        Block *head = m_returned.load(std::memory_order_relaxed);
+        do {
+            last->nextBatch = head;
+        } while (!m_returned.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // 取走归还链表的第一串，其余的串放回去
+    Block *popBatch() {
+        Block *first = m_returned.exchange(nullptr, std::memory_order_acquire);
+        if (!first) {
+            return nullptr;
+        }
+        Block *rest = first->nextBatch;
+        if (rest) {
+            Block *expected = nullptr;
+            if (!m_returned.compare_exchange_strong(expected, rest, std::memory_order_release, std::memory_order_relaxed)) {
+                // 期间其他线程又放回了块，把剩下的串接到它们前面
+                Block *last = rest;
+                while (last->nextBatch) {
+                    last = last->nextBatch;
+                }
+                pushBatches(rest, last);
+            }
+        }
+        return first;
+    }
+
+    // 申请一个slab并按CACHE_LIMIT切成若干串，返回第一串，其余的挂到归还链表上
+    Block *newSlab() {
+        char *slab = (char *)malloc(SLAB_BYTES);
+        if (!slab) {
+            throw std::bad_alloc();
+        }
+        m_slabs.fetch_add(1, std::memory_order_relaxed);
+        size_t blocks = SLAB_BYTES / BLOCK_SIZE;
+        auto at = [slab](size_t i) { return (Block *)(slab + i * BLOCK_SIZE); };
+        Block *spareFirst = nullptr;
+        Block *spareLast = nullptr;
+        for (size_t begin = 0; begin < blocks; begin += CACHE_LIMIT) {
+            size_t end = begin + CACHE_LIMIT < blocks ? begin + CACHE_LIMIT : blocks;
+            for (size_t i = begin; i < end; i++) {
+                at(i)->next = i + 1 < end ? at(i + 1) : nullptr;
+            }
+            Block *head = at(begin);
+            head->count = end - begin;
+            head->nextBatch = nullptr;
+            if (begin == 0) {
+                continue;
+            }
+            if (spareLast) {
+                spareLast->nextBatch = head;
+            } else {
+                spareFirst = head;
+            }
+            spareLast = head;
+        }
+        if (spareFirst) {
+            pushBatches(spareFirst, spareLast);
+        }
+        return at(0);
+    }
+
+private:
+    static inline thread_local Cache t_cache;
+    static inline thread_local Reclaimer t_reclaimer;
+
+    std::atomic<Block *> m_returned {nullptr}; // 共享的归还链表，由若干串块按串首的nextBatch相连组成
+    std::atomic<uint64_t> m_slabs {0};
+    std::atomic<uint64_t> m_returns {0};
+    std::atomic<uint64_t> m_reclaims {0};
+};
+
+// 对象类型T对应的池
+template<class T>
+using ObjectPool = SlabPool<sizeof(T), alignof(T)>;
+
+/**
+ * @brief 标准库容器和shared_ptr控制块使用的分配器，单个对象从池里分配，数组仍用全局new
+ */
+template<class T>
+struct PoolAllocator {
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template<class U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+#if KSC_OBJECT_POOL
+        if (n == 1) {
+            return (T *)ObjectPool<T>::GetInstance().allocate();
+        }
+#endif
+        return (T *)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T *p, size_t n) {
+#if KSC_OBJECT_POOL
+        if (n == 1) {
+            ObjectPool<T>::GetInstance().deallocate(p);
+            return;
+        }
+#endif
+        ::operator delete(p);
+    }
+
+    template<class U>
+    bool operator==(const PoolAllocator<U> &) const { return true; }
+    template<class U>
+    bool operator!=(const PoolAllocator<U> &) const { return false; }
+};
+
+/**
+ * @brief 继承后T的new/delete走对象池，派生类大小不同时退回全局new/delete
+ */
+template<class T>
+class PoolObject {
+public:
+    static void *operator new(size_t size) {
+#if KSC_OBJECT_POOL
+        if (size == sizeof(T)) {
+            return ObjectPool<T>::GetInstance().allocate();
+        }
+#endif
+        return ::operator new(size);
+    }
+
+    static void operator delete(void *p, size_t size) {
+#if KSC_OBJECT_POOL
+        if (size == sizeof(T)) {
+            ObjectPool<T>::GetInstance().deallocate(p);
+            return;
+        }
+#endif
+        ::operator delete(p);
+    }
+};
+
+/**
+ * @brief 创建一个shared_ptr，对象本身和控制块都从池里分配，用于构造函数不公开、不能用allocate_shared的类型
+ */
+template<class T>
+std::shared_ptr<T> MakePooledShared(T *object) {
+    return std::shared_ptr<T>(object, std::default_delete<T>(), PoolAllocator<T>());
+}
+
+};
+
+#endif // OBJECT_POOL_H
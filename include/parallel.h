@@ -0,0 +1,153 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <exception>
+#include <algorithm>
+#include <functional>
+
+#include "scheduler.h"
+#include "doroutineSync.h"
+#include "mutex.h"
+
+namespace KSC {
+
+/**
+ * @brief parallelFor/parallelReduce共享的分块状态
+ * @details 区间按grain切成固定大小的块，参与者（调用方和调度到各工作线程上的帮手任务）用一个原子下标轮流领取，
+ * 先做完的参与者自然多领，负载均衡的效果和工作窃取相当，但不需要每线程的双端队列。
+ * 每个参与者做完后按自己领到的块数一次性归还计数，调用方等计数归零。
+ * 帮手任务可能在所有块领完之后才开始执行，所以状态用共享指针管理；帮手先领到一块才会进入调用方栈上的执行体，
+ * 领到了说明调用方还在等这一块，执行体一定有效
+ */
+template<class Index>
+struct ParallelRange {
+    using Participant = std::function<void(ParallelRange &, size_t)>;
+
+    Index begin;
+    Index end;
+    Index grain;
+    size_t chunks;
+    std::atomic<size_t> next {0};
+    WaitGroup wg;
+    std::atomic<bool> failed {false};
+    std::exception_ptr error; // 第一个抛出的异常，出错后剩下的块只领取不执行
+
+    ParallelRange(Index _begin, Index _end, Index _grain)
+        : begin(_begin), end(_end), grain(_grain)
+        , chunks(_begin < _end ? (size_t)((_end - _begin + _grain - 1) / _grain) : 0)
+        , wg((int64_t)chunks) {}
+
+    size_t claim() { return next.fetch_add(1, std::memory_order_relaxed); }
+
+    // 从已经领到的first开始执行，并继续领取直到全部领完，返回本参与者领到的块数
+    template<class Body>
+    size_t drain(size_t first, Body &&body) {
+        size_t claimed = 0;
+        for (size_t index = first; index < chunks; index = claim()) {
+            ++claimed;
+            if (failed.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            Index lo = begin + (Index)index * grain;
+            Index hi = end - lo > grain ? lo + grain : end;
+            try {
+                body(lo, hi);
+            } catch (...) {
+                bool expected = false;
+                if (failed.compare_exchange_strong(expected, true)) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        return claimed;
+    }
+
+    // 一次归还claimed个块的计数，最后一次done负责唤醒调用方
+    void finish(size_t claimed) {
+        if (claimed == 0) {
+            return;
+        }
+        if (claimed > 1) {
+            wg.add(-(int64_t)(claimed - 1));
+        }
+        wg.done();
+    }
+
+    /**
+     * @brief 调度帮手并让调用方一起领取，全部块完成后返回，有异常时重新抛出第一个
+     * @param participant 参与者的执行体，参数为状态和已经领到的第一块，返回前必须调用finish
+     */
+    static void run(const std::shared_ptr<ParallelRange> &state, Scheduler *scheduler, const Participant &participant) {
+        if (state->chunks == 0) {
+            return;
+        }
+        if (scheduler && state->chunks > 1) {
+            // 帮手数量不超过工作线程数，调用方自己也是一个参与者
+            size_t helpers = std::min(state->chunks - 1, std::max<size_t>(1, scheduler->getStats().threads));
+            const Participant *body = &participant;
+            for (size_t i = 0; i < helpers; i++) {
+                scheduler->schedule(std::function<void()>([state, body]() {
+                    size_t first = state->claim();
+                    if (first < state->chunks) {
+                        (*body)(*state, first);
+                    }
+                }));
+            }
+        }
+        participant(*state, state->claim());
+        // 在协程里只挂起当前协程，工作线程继续执行其他任务
+        state->wg.wait();
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+};
+
+/**
+ * @brief 把[begin, end)按grain切块，在scheduler的工作线程上并行执行func(lo, hi)，调用方也参与执行，全部完成后返回
+ * @details scheduler为空时在调用方串行执行；func抛出的第一个异常在全部块结束后重新抛出，出错后尚未开始的块不再执行
+ */
+template<class Index, class Func>
+void parallelFor(Index begin, Index end, Index grain, Func &&func, Scheduler *scheduler = Scheduler::GetThis()) {
+    auto state = std::make_shared<ParallelRange<Index>>(begin, end, grain > 0 ? grain : 1);
+    typename ParallelRange<Index>::Participant participant = [&func](ParallelRange<Index> &range, size_t first) {
+        range.finish(range.drain(first, func));
+    };
+    ParallelRange<Index>::run(state, scheduler, participant);
+}
+
+/**
+ * @brief 并行归约，每块计算map(lo, hi)，结果用combine合并，返回combine(identity, 各块结果...)
+ * @details 每个参与者先在本地合并自己领到的块，最后加锁合并一次；合并顺序不固定，combine需要满足结合律和交换律
+ */
+template<class Index, class T, class Map, class Combine>
+T parallelReduce(Index begin, Index end, Index grain, T identity, Map &&map, Combine &&combine,
+                 Scheduler *scheduler = Scheduler::GetThis()) {
+    T result = std::move(identity);
+    adaptive_mutex mtx;
+    auto state = std::make_shared<ParallelRange<Index>>(begin, end, grain > 0 ? grain : 1);
+    typename ParallelRange<Index>::Participant participant = [&](ParallelRange<Index> &range, size_t first) {
+        std::optional<T> partial;
+        size_t claimed = range.drain(first, [&](Index lo, Index hi) {
+            if (partial) {
+                partial = combine(std::move(*partial), map(lo, hi));
+            } else {
+                partial.emplace(map(lo, hi));
+            }
+        });
+        if (partial) {
+            adaptive_lock lck(mtx);
+            result = combine(std::move(result), std::move(*partial));
+        }
+        range.finish(claimed);
+    };
+    ParallelRange<Index>::run(state, scheduler, participant);
+    return result;
+}
+
+};
+
+#endif // PARALLEL_H
@@ -0,0 +1,106 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace KSC {
+
+/**
+ * @brief 基于epoch的延迟回收域
+ * @details 读者进入临界区时把当前全局epoch登记到自己线程的槽位上，离开时清零，整个过程没有锁；
+ * 写者发布新快照后推进全局epoch，旧快照挂到回收列表上，等所有活跃读者登记的epoch都不小于
+ * 回收时的epoch后再释放。读临界区内不能yield协程，否则会一直阻止回收
+ */
+class RcuDomain {
+public:
+    static RcuDomain *GetInstance();
+
+    /**
+     * @brief 进入读临界区，可以嵌套
+     */
+    void readLock();
+
+    /**
+     * @brief 离开读临界区
+     */
+    void readUnlock();
+
+    /**
+     * @brief 延迟释放ptr，调用前ptr必须已经从所有RcuPtr上摘下
+     */
+    void retire(void *ptr, void (*deleter)(void *));
+
+private:
+    /**
+     * @brief 读者槽位，按线程分配，线程退出后归还复用，永不释放
+     */
+    struct Reader {
+        std::atomic<uint64_t> epoch {0}; // 0表示不在读临界区内
+        uint32_t depth = 0;
+        std::atomic<bool> inUse {false};
+        Reader *next = nullptr;
+    };
+
+    struct Retired {
+        void *ptr;
+        void (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+    RcuDomain() = default;
+    Reader *getReader();
+    void reclaim();
+
+private:
+    std::atomic<uint64_t> m_epoch {1};
+    std::atomic<Reader *> m_readers {nullptr};
+    std::mutex m_retireMtx;
+    std::vector<Retired> m_retired;
+};
+
+/**
+ * @brief 读临界区守卫
+ */
+class RcuReadGuard {
+public:
+    RcuReadGuard() { RcuDomain::GetInstance()->readLock(); }
+    ~RcuReadGuard() { RcuDomain::GetInstance()->readUnlock(); }
+
+    RcuReadGuard(const RcuReadGuard &other) = delete;
+    RcuReadGuard &operator=(const RcuReadGuard &other) = delete;
+};
+
+/**
+ * @brief 发布不可变快照的指针
+ * @details 读者在RcuReadGuard内load()得到的快照在离开临界区前一直有效；
+ * 写者需要自己串行化，拷贝一份旧快照修改后store()，旧快照交给RcuDomain延迟释放
+ */
+template<class T>
+class RcuPtr {
+public:
+    explicit RcuPtr(T *ptr = nullptr) : m_ptr(ptr) {}
+
+    ~RcuPtr() { delete m_ptr.load(std::memory_order_relaxed); }
+
+    const T *load() const { return m_ptr.load(std::memory_order_acquire); }
+
+    void store(T *ptr) {
+        T *old = m_ptr.exchange(ptr, std::memory_order_seq_cst);
+        if (old) {
+            RcuDomain::GetInstance()->retire(old, [](void *p) { delete (T *)p; });
+        }
+    }
+
+    RcuPtr(const RcuPtr &other) = delete;
+    RcuPtr &operator=(const RcuPtr &other) = delete;
+
+private:
+    std::atomic<T *> m_ptr;
+};
+
+};
+
+#endif
@@ -5,36 +5,184 @@
 #include <memory>
 #include <thread>
 #include <list>
+#include <deque>
 #include <vector>
 #include <string>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <type_traits>
 
 #include "doroutine.h"
 #include "log.h"
+#include "mutex.h"
+#include "util.h"
+#include "objectPool.h"
 
 namespace KSC {
+
+struct LocalQueue;
+
+/**
+ * @brief 调度器的可选配置
+ */
+struct SchedulerOptions {
+    // 工作线程依次绑定到的CPU，线程数多于CPU数时循环使用；为空时不绑定。useCaller的线程属于调用方，不会被绑定
+    std::vector<int> cpus;
+    // 为true时工作线程在绑定CPU后，把自己的内存分配策略设为优先使用该CPU所在的NUMA节点，
+    // 之后在线程上创建的调度协程、idle协程、任务协程的栈以及本地队列都从本节点分配
+    bool numaLocal = false;
+
+    // 弹性线程池：构造函数的threads为线程数下限，maxThreads为上限（同样包括useCaller的线程），不大于下限时线程数固定
+    size_t maxThreads = 0;
+    // 全局队列长度达到该值且没有空闲线程时扩容
+    size_t growQueueDepth = 64;
+    // 任务在全局队列里等待超过该时间（微秒）且没有空闲线程时扩容
+    uint64_t growWaitUs = 2000;
+    // 两次扩容之间至少间隔的时间（微秒），避免一次突发就把线程开满
+    uint64_t growIntervalUs = 1000;
+    // 超出下限的工作线程连续空闲超过该时间（毫秒）后退出
+    uint64_t retireIdleMs = 10000;
+
+    // 大于0时启动监控线程，工作线程在同一个协程里停留超过该时间（毫秒）视为卡住，记录错误日志
+    uint64_t stallThresholdMs = 0;
+    // 有工作线程卡住且全局队列里还有任务时，临时增加工作线程接手，临时线程空闲后退出
+    bool compensateStall = false;
+    // 大于0时启动监控线程，协程连续运行超过该时间（毫秒）后置位所在工作线程的抢占标记，
+    // 协程在下一个Doroutine::maybeYield()检查点让出并排到全局队列末尾
+    uint64_t timeSliceMs = 0;
+
+    // 最高优先级之下各优先级的权重，全局队列按权重轮流从普通和低优先级队列取任务，低优先级任务不会饿死
+    uint32_t normalWeight = 4;
+    uint32_t lowWeight = 1;
+
+    // 大于0时开启CoDel式过载检测：任务从入队到开始执行的等待时间连续一个codelIntervalUs都高于该目标（微秒），
+    // 调度器进入过载状态，trySchedule拒绝低优先级任务，hook的accept暂停接受新连接；队列排空或等待时间回落后退出过载
+    uint64_t codelTargetUs = 0;
+    uint64_t codelIntervalUs = 100000;
+};
+
+/**
+ * @brief 调度器的线程数统计，用于观察弹性线程池的扩缩容
+ */
+struct SchedulerStats {
+    size_t threads = 0; // 当前工作线程数，不包括useCaller的线程
+    size_t peakThreads = 0; // 工作线程数峰值
+    uint64_t grows = 0; // 扩容次数
+    uint64_t retires = 0; // 空闲退出的线程数
+    uint64_t stalls = 0; // 监控线程发现的卡住次数
+    uint64_t compensations = 0; // 为卡住的线程临时增加的工作线程数
+    uint64_t preemptions = 0; // 时间片用完后在检查点让出的次数
+    // 所有协程的时间片超时到检查点让出之间的延迟分布，分桶方式和Doroutine::getOverrunCount相同
+    static constexpr size_t OVERRUN_BUCKETS = Doroutine::OVERRUN_BUCKETS;
+    uint64_t overrunHistogram[OVERRUN_BUCKETS] = {0};
+    // 按优先级（与Scheduler::Priority对应）统计任务在全局队列里的等待时间，经过本地队列的任务不计入
+    static constexpr size_t PRIORITY_CLASSES = 3;
+    uint64_t dequeued[PRIORITY_CLASSES] = {0}; // 从全局队列取出的任务数
+    uint64_t waitTotalUs[PRIORITY_CLASSES] = {0}; // 等待时间总和（微秒）
+    uint64_t waitMaxUs[PRIORITY_CLASSES] = {0}; // 最长等待时间（微秒）
+    uint64_t overloads = 0; // 进入过载状态的次数
+    uint64_t shed = 0; // 过载时被trySchedule拒绝的任务数
+};
+
 class Scheduler {
 public:
-    Scheduler(size_t threads = 1, bool useCaller = true, const std::string &name = "scheduler");
+    /**
+     * @brief 任务优先级，HIGH严格优先于其他优先级，NORMAL和LOW之间按权重轮转
+     * @details DEFAULT表示不指定：调度协程时沿用协程上次被指定的优先级，没有指定过或调度函数时为NORMAL
+     */
+    enum Priority {
+        PRIORITY_DEFAULT = -1,
+        PRIORITY_HIGH = 0,
+        PRIORITY_NORMAL = 1,
+        PRIORITY_LOW = 2,
+        PRIORITY_COUNT = 3
+    };
+
+    Scheduler(size_t threads = 1, bool useCaller = true, const std::string &name = "scheduler",
+              const SchedulerOptions &options = SchedulerOptions());
     virtual ~Scheduler();
     void start();
     void stop();
     const std::string &getName() const { return m_name; }
+    const SchedulerOptions &getOptions() const { return m_options; }
+    SchedulerStats getStats();
+
+    // 协程挂起等待调度器之外的线程（如阻塞线程池）唤醒期间计数，计数不为0时调度器不会停止
+    void addExternalWait() { ++m_externalWaits; }
+    void removeExternalWait() { --m_externalWaits; }
 
     template <class DoroutineOrCb>
-    void schedule(DoroutineOrCb fc, int thread = -1) {
+    void schedule(DoroutineOrCb fc, int thread = -1, Priority priority = PRIORITY_DEFAULT) {
+        if constexpr (std::is_same<DoroutineOrCb, Doroutine::ptr>::value) {
+            // 低优先级的协程不插队
+            if (m_runNext.load(std::memory_order_relaxed) && fc && resolvePriority(fc, priority) != PRIORITY_LOW
+                && scheduleRunNext(fc, thread)) {
+                return;
+            }
+        }
         bool needTickle = false;
+        size_t depth = 0;
         {
-            std::lock_guard<std::mutex> lck(m_mtx);
-            needTickle = scheduleNoLock(fc, thread);
+            std::lock_guard<adaptive_mutex> lck(m_mtx);
+            needTickle = scheduleNoLock(fc, thread, priority);
+            depth = m_taskCount;
         }
 
         if (needTickle) {
             tickle(); // 唤醒idle协程
         }
+        if (m_elastic && depth >= m_options.growQueueDepth && !hasIdleThreads()) {
+            grow();
+        }
+    }
+
+    /**
+     * @brief 过载时拒绝低优先级任务的schedule，任务被接受时返回true，被拒绝时返回false且不会执行
+     * @details 只有开启了codelTargetUs、调度器处于过载状态且任务实际优先级为LOW时才拒绝，其他情况等同于schedule
+     */
+    template <class DoroutineOrCb>
+    bool trySchedule(DoroutineOrCb fc, int thread = -1, Priority priority = PRIORITY_DEFAULT) {
+        if (isOverloaded()) {
+            bool low = false;
+            if constexpr (std::is_same<DoroutineOrCb, Doroutine::ptr>::value) {
+                low = fc && resolvePriority(fc, priority) == PRIORITY_LOW;
+            } else {
+                low = priority == PRIORITY_LOW;
+            }
+            if (low) {
+                std::lock_guard<adaptive_mutex> lck(m_mtx);
+                ++m_stats.shed;
+                return false;
+            }
+        }
+        schedule(fc, thread, priority);
+        return true;
     }
 
+    // 任务排队时间是否持续超过codelTargetUs，未开启过载检测时总是false
+    bool isOverloaded() const { return m_overloaded.load(std::memory_order_relaxed); }
+
+    /**
+     * 开启后，工作线程上的任务唤醒本调度器的协程时，被唤醒的协程放进该线程的LIFO"下一个运行"槽位，
+     * 当前任务让出后立即在本线程上运行，而不是排到全局队列末尾；槽位已被占用时，原来的协程退回全局队列
+     */
+    void setRunNext(bool on) { m_runNext.store(on, std::memory_order_relaxed); }
+    bool isRunNext() const { return m_runNext.load(std::memory_order_relaxed); }
+
+    // 当前工作线程上运行的协程时间片是否已经用完
+    static bool PreemptRequested();
+    // 把时间片用完的当前协程放回全局队列末尾并记录统计，bucket返回超时延迟所在的桶，之后由调用方yield；不在工作线程的任务协程里时返回false
+    static bool RequeuePreempted(const Doroutine::ptr &doroutine, size_t &bucket);
+
+    /**
+     * @brief 把当前协程迁移到target调度器上继续执行，thread不为-1时固定到target的该线程
+     * @details 当前协程先在原线程上让出，由原调度循环在上下文保存完毕后放进target的队列，之后在target的线程上从这里返回，
+     * 沿用同一个栈和协程对象，不分配新任务。target必须已经启动且没有停止；原调度器不会等待迁出的协程，
+     * 需要迁回时由调用方保证原调度器仍在运行。不在调度器的任务协程里调用时返回false
+     */
+    static bool SwitchTo(Scheduler *target, int thread = -1);
+
     static Scheduler *GetThis();
     // static Doroutine::ptr GetMainDoroutine();
     static Doroutine *GetMainDoroutine();
@@ -46,13 +194,38 @@ protected:
 
     void run();
     void setThis();
+    void bindWorker(size_t index); // 按配置绑定第index个工作线程的CPU和NUMA节点
+    void runWorker(size_t index, bool temporary); // 线程池里工作线程的入口
+    void grow(); // 弹性模式下增加一个工作线程
+    void spawnWorkerNoLock(bool temporary); // 创建一个工作线程，调用前持有m_mtx
+    void reapExitedNoLock(std::vector<std::thread*> &exited); // 从线程池取出已经退出的线程，由调用方在锁外join
+    bool tryRetire(bool temporary); // 当前工作线程申请退出，普通线程在线程数已到下限时返回false
+    void monitor(); // 监控线程的入口
+    void checkWorkers();
+    bool isRetiredNoLock(int thread) const;
+    // 当前工作线程是否已决定空闲退出，idle协程看到后应当返回
+    static bool IsRetiring();
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
+    bool isElastic() const { return m_elastic; }
+
+    /**
+     * 把协程放进当前工作线程的本地就绪队列，回到调度循环后优先执行，不经过全局队列的锁也不唤醒其他线程
+     * 只能在本调度器的工作线程上调用，并且协程不能正在其他线程上运行；队列已满或不在工作线程上时返回false
+     */
+    bool scheduleLocal(Doroutine::ptr doroutine);
+
+    static constexpr size_t LOCAL_READY_CAPACITY = 64;
+    // 连续执行本地任务（槽位和本地就绪队列）的上限，达到后先看一眼全局队列，防止全局任务饿死
+    static constexpr int LOCAL_STREAK_LIMIT = 3;
 
 private:
     struct SchedulerTask {
         Doroutine::ptr doroutine = nullptr;
         std::function<void()> func = nullptr;
         int thread = -1; // 指定执行此任务的线程id，-1表示任意线程均可执行
+        int priority = PRIORITY_NORMAL; // 已确定的优先级，不会是PRIORITY_DEFAULT
+
+        uint64_t enqueueUs = 0; // 入队时间
 
         SchedulerTask(Doroutine::ptr _doroutine, int _thread) 
             : doroutine(_doroutine), thread(_thread) {}
@@ -67,35 +240,117 @@ private:
             doroutine = nullptr;
             func = nullptr;
             thread = -1;
+            priority = PRIORITY_NORMAL;
+            enqueueUs = 0;
         }
     };
+    // 队列节点由入队的线程分配、出队的工作线程释放，走对象池的跨线程归还
+    using TaskList = std::list<SchedulerTask, PoolAllocator<SchedulerTask>>;
 
 private:
+    // 工作线程的执行进度，由工作线程更新，监控线程读取
+    struct WorkerProgress {
+        using ptr = std::shared_ptr<WorkerProgress>;
+        static constexpr uint64_t NONE = ~0ull;
+
+        int thread = -1;
+        std::atomic<uint64_t> ticks {0}; // 每开始执行一个任务加1
+        std::atomic<uint64_t> running {NONE}; // 正在执行的协程id，NONE表示不在执行任务
+        std::atomic<bool> preempt {false}; // 时间片用完，由监控线程置位
+        std::atomic<uint64_t> preemptAtUs {0}; // 置位抢占标记的时间
+
+        LocalQueue *local = nullptr; // 本线程的本地任务，只在m_mtx下读写，线程退出前置空
+
+        // 以下只由监控线程访问
+        uint64_t seenTicks = 0;
+        uint64_t seenSinceMs = 0;
+        bool stalled = false;
+
+        void begin(uint64_t id) {
+            preempt.store(false, std::memory_order_relaxed);
+            ticks.store(ticks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            running.store(id, std::memory_order_relaxed);
+        }
+        void end() { running.store(NONE, std::memory_order_relaxed); }
+    };
+
+    bool scheduleRunNext(Doroutine::ptr &doroutine, int thread);
+    // 把卡住的线程的本地任务移到全局队列，moved返回移动的数量，返回是否需要tickle
+    bool stealLocalNoLock(WorkerProgress &worker, size_t &moved);
+
+    // 确定任务的实际优先级，指定了优先级的协程记住它，之后不指定优先级的唤醒沿用
+    template <class DoroutineOrCb>
+    static int resolvePriority(DoroutineOrCb &fc, int priority) {
+        if constexpr (std::is_same<DoroutineOrCb, Doroutine::ptr>::value) {
+            // 可能和协程所在线程并发读写，只读一次
+            if (priority != PRIORITY_DEFAULT) {
+                fc->setPriority(priority);
+            } else if (int remembered = fc->getPriority(); remembered != PRIORITY_DEFAULT) {
+                return remembered;
+            }
+        }
+        return priority == PRIORITY_DEFAULT ? PRIORITY_NORMAL : priority;
+    }
+
     template <class DoroutineOrCb>
-    bool scheduleNoLock(DoroutineOrCb fc, int thread) {
-        bool need_tickle = m_tasks.empty();
+    bool scheduleNoLock(DoroutineOrCb fc, int thread, int priority = PRIORITY_DEFAULT) {
+        bool need_tickle = m_taskCount == 0;
         SchedulerTask task(fc, thread);
         if (task.doroutine || task.func) {
-            m_tasks.push_back(task);
+            task.priority = task.doroutine ? resolvePriority(task.doroutine, priority)
+                                           : (priority == PRIORITY_DEFAULT ? PRIORITY_NORMAL : priority);
+            task.enqueueUs = KSC::GetElapsedUS();
+            m_tasks[task.priority].push_back(task);
+            ++m_taskCount;
         }
         return need_tickle;
     }
 
+    // 从一个优先级队列里取出第一个当前线程可以执行的任务，调用前持有m_mtx
+    bool takeTaskNoLock(TaskList &tasks, SchedulerTask &task, bool &tickleMe);
+    // 按优先级从全局队列取任务：HIGH严格优先，NORMAL和LOW按权重轮转，调用前持有m_mtx
+    bool dequeueNoLock(SchedulerTask &task, bool &tickleMe);
+    // 根据刚取出的任务的排队时间更新过载状态，调用前持有m_mtx
+    void updateOverloadNoLock(uint64_t sojournUs, uint64_t now);
+
 private:
     std::string m_name; // 协程调度器名称
-    std::mutex m_mtx; // 互斥锁
+    SchedulerOptions m_options;
+    adaptive_mutex m_mtx; // 互斥锁，任务队列的临界区很短，竞争时先自旋再睡眠
     std::vector<std::thread*> m_threadPool; // 线程池
-    std::list<SchedulerTask> m_tasks; // 任务队列
+    TaskList m_tasks[PRIORITY_COUNT]; // 按优先级分开的全局任务队列
+    size_t m_taskCount = 0; // 各优先级队列的任务总数
+    uint32_t m_weightCursor = 0; // 加权轮转的位置，小于normalWeight时优先取普通任务，否则优先取低优先级任务
+    uint64_t m_aboveTargetUntilUs = 0; // 排队时间高于目标后，到这个时间仍没有回落就进入过载，0表示当前低于目标
+    std::atomic<bool> m_overloaded {false};
     std::vector<int> m_threadIds;
     size_t m_threadCount; // 工作线程数量，不包括useCaller的主线程
     std::atomic<size_t> m_activeThreadCount {0};
     std::atomic<size_t> m_idleThreadCount {0};
+    std::atomic<size_t> m_externalWaits {0};
 
     bool m_useCaller; // 是否use caller
     Doroutine::ptr m_rootDoroutine; // user_caller为true时，调度器所在线程的调度协程
     int m_rootThreadId = 0; // useCaller为true时，调度器所在线程的id
 
     bool m_stopping = false; // 是否正在停止
+
+    bool m_elastic = false; // 是否启用弹性线程池
+    size_t m_maxThreadCount = 0; // 工作线程数上限，不包括useCaller的线程
+    size_t m_nextWorkerIndex = 0; // 下一个工作线程的序号，用于选择绑定的CPU
+    uint64_t m_lastGrowUs = 0; // 上次扩容的时间
+    std::vector<int> m_retiredThreadIds; // 已退出的工作线程id，固定到这些线程的任务改由任意线程执行
+    std::vector<std::thread::id> m_exitedThreads; // 已退出但还没有join的线程
+    SchedulerStats m_stats; // 受m_mtx保护
+    size_t m_temporaryThreads = 0; // 还没退出的临时工作线程数
+
+    static thread_local WorkerProgress *st_progress; // 当前工作线程的进度，没有启用监控时为空
+    std::vector<WorkerProgress::ptr> m_workers; // 各工作线程的进度，只在启用监控时登记
+    std::thread *m_monitor = nullptr;
+    std::mutex m_monitorMtx;
+    std::condition_variable m_monitorCond;
+    bool m_monitorStop = false;
+    std::atomic<bool> m_runNext {false}; // 是否启用LIFO下一个运行槽位
 };
 
 };
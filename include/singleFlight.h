@@ -0,0 +1,79 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <unordered_map>
+#include <functional>
+
+#include "future.h"
+#include "mutex.h"
+
+namespace KSC {
+
+/**
+ * @brief 合并对同一个key的并发调用
+ * @details 第一个调用者真正执行func，执行期间到达的同key调用者挂起在同一个Future上，拿到同样的结果或异常；
+ * 执行结束后key从表中移除，之后的调用会重新执行
+ */
+template<class K, class V, class Hash = std::hash<K>>
+class SingleFlight {
+public:
+    SingleFlight() = default;
+
+    /**
+     * @brief 执行或加入对key的调用，shared不为空时返回结果是否来自其他调用者
+     */
+    template<class Func>
+    V call(const K &key, Func &&func, bool *shared = nullptr) {
+        Promise<V> promise;
+        {
+            adaptive_lock lck(m_mtx);
+            auto it = m_inflight.find(key);
+            if (it != m_inflight.end()) {
+                Future<V> future = it->second;
+                lck.unlock();
+                if (shared) {
+                    *shared = true;
+                }
+                return future.get();
+            }
+            m_inflight.emplace(key, promise.getFuture());
+        }
+        if (shared) {
+            *shared = false;
+        }
+
+        try {
+            V value = func();
+            forget(key);
+            promise.setValue(value);
+            return value;
+        } catch (...) {
+            forget(key);
+            promise.setException(std::current_exception());
+            throw;
+        }
+    }
+
+    // 正在执行中的key数量
+    size_t inflight() {
+        adaptive_lock lck(m_mtx);
+        return m_inflight.size();
+    }
+
+    SingleFlight(const SingleFlight &other) = delete;
+    SingleFlight &operator=(const SingleFlight &other) = delete;
+
+private:
+    void forget(const K &key) {
+        adaptive_lock lck(m_mtx);
+        m_inflight.erase(key);
+    }
+
+private:
+    adaptive_mutex m_mtx;
+    std::unordered_map<K, Future<V>, Hash> m_inflight;
+};
+
+};
+
+#endif // SINGLE_FLIGHT_H
@@ -0,0 +1,60 @@
+#ifndef STRAND_H
+#define STRAND_H
+
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "scheduler.h"
+
+namespace KSC {
+
+/**
+ * @brief 串行执行器，投递到同一个Strand的任务按FIFO顺序逐个执行，不会并发，执行期间不持有任何锁
+ * @details 任务挂在无锁的多生产者单消费者链表上，尾指针最低位表示Strand空闲。投递只需一次原子交换，
+ * 换出的旧尾指针带空闲标记时由投递方调度一个排空任务；排空任务一次最多执行BATCH个任务，
+ * 还有剩余就把自己重新固定调度到当前线程，队列为空时用CAS把尾指针标记为空闲后退出。
+ * 任务里可以挂起协程，挂起期间Strand仍视为忙，后面的任务继续排队。
+ * 排空任务持有Strand的共享指针，所以Strand必须用make_shared创建
+ */
+class Strand : public std::enable_shared_from_this<Strand> {
+public:
+    using ptr = std::shared_ptr<Strand>;
+
+    explicit Strand(Scheduler *scheduler = Scheduler::GetThis());
+    ~Strand();
+
+    void post(std::function<void()> task);
+
+    // 当前协程是否正在执行这个Strand的任务
+    bool runningInThisStrand() const;
+
+    Scheduler *getScheduler() const { return m_scheduler; }
+
+    Strand(const Strand &other) = delete;
+    Strand &operator=(const Strand &other) = delete;
+
+private:
+    struct Node {
+        std::atomic<Node *> next {nullptr};
+        std::function<void()> task;
+    };
+
+    void scheduleDrain(int thread);
+    void drain();
+
+private:
+    static constexpr uintptr_t IDLE = 1;
+    static constexpr int BATCH = 64;
+
+    Scheduler *m_scheduler;
+    alignas(64) std::atomic<uintptr_t> m_tail; // 生产者交换的尾指针，最低位为空闲标记
+    alignas(64) Node *m_head; // 已经执行过的最后一个节点，只有排空任务访问
+    std::atomic<int> m_lastThread {-1}; // 最近一次执行排空任务的线程
+    std::atomic<uint64_t> m_owner {~0ull}; // 正在执行排空任务的协程id，任务挂起后可能换线程恢复，所以不用thread_local记录
+};
+
+};
+
+#endif // STRAND_H
@@ -0,0 +1,102 @@
+#ifndef TASK_GROUP_H
+#define TASK_GROUP_H
+
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <exception>
+#include <functional>
+#include <type_traits>
+
+#include "scheduler.h"
+#include "doroutineSync.h"
+
+namespace KSC {
+
+/**
+ * @brief 把一组子任务分发到调度器上并等待它们全部完成，收集每个子任务的返回值或异常
+ * @details 每次spawn时在结果队列末尾预留一个位置，子任务只写自己的位置，完成时只对计数做一次原子减，
+ * 不需要加锁。等待超时后仍在运行的子任务通过共享状态继续写结果，不会访问已经销毁的TaskGroup。
+ * spawn和wait只能由创建TaskGroup的一方调用
+ * @tparam T 子任务返回值类型，可以为void
+ */
+template<class T>
+class TaskGroup {
+public:
+    using Value = std::conditional_t<std::is_void<T>::value, bool, T>;
+
+    struct Outcome {
+        std::optional<Value> value; // 成功时有值，void任务为true
+        std::exception_ptr error;   // 子任务抛出的异常
+        std::atomic<bool> ready {false};
+    };
+
+    explicit TaskGroup(Scheduler *scheduler = Scheduler::GetThis())
+        : m_scheduler(scheduler)
+        , m_state(std::make_shared<State>()) {}
+
+    template<class Func>
+    void spawn(Func &&func) {
+        std::shared_ptr<State> state = m_state;
+        Outcome *outcome = &state->outcomes.emplace_back();
+        state->wg.add(1);
+        m_scheduler->schedule(std::function<void()>([state, outcome, func = std::forward<Func>(func)]() mutable {
+            try {
+                if constexpr (std::is_void<T>::value) {
+                    func();
+                    outcome->value = true;
+                } else {
+                    outcome->value = func();
+                }
+            } catch (...) {
+                outcome->error = std::current_exception();
+            }
+            outcome->ready.store(true, std::memory_order_release);
+            state->wg.done();
+        }));
+    }
+
+    // 等待全部子任务完成
+    void wait() { m_state->wg.wait(); }
+
+    /**
+     * @brief 最多等待timeoutMs毫秒，全部完成返回true，超时返回false
+     */
+    bool waitFor(uint64_t timeoutMs) { return m_state->wg.waitFor(timeoutMs); }
+
+    /**
+     * @brief 按spawn顺序排列的结果，超时返回后只能读取ready为true的项
+     */
+    const std::deque<Outcome> &results() const { return m_state->outcomes; }
+
+    /**
+     * @brief 按spawn顺序重新抛出第一个子任务异常，没有异常则什么也不做
+     */
+    void rethrowFirstError() const {
+        for (const Outcome &outcome : m_state->outcomes) {
+            if (outcome.ready.load(std::memory_order_acquire) && outcome.error) {
+                std::rethrow_exception(outcome.error);
+            }
+        }
+    }
+
+    size_t size() const { return m_state->outcomes.size(); }
+    size_t pending() const { return (size_t)m_state->wg.count(); }
+
+    TaskGroup(const TaskGroup &other) = delete;
+    TaskGroup &operator=(const TaskGroup &other) = delete;
+
+private:
+    struct State {
+        WaitGroup wg;
+        std::deque<Outcome> outcomes; // deque在尾部追加时不会移动已有元素，子任务持有的指针一直有效
+    };
+
+    Scheduler *m_scheduler;
+    std::shared_ptr<State> m_state;
+};
+
+};
+
+#endif // TASK_GROUP_H
@@ -8,12 +8,14 @@
 #include <memory>
 #include <functional>
 
+#include "objectPool.h"
+
 namespace KSC {
 
 class TimerManager;
 
 
-class Timer : public std::enable_shared_from_this<Timer> {
+class Timer : public std::enable_shared_from_this<Timer>, public PoolObject<Timer> {
 friend class TimerManager;
 public:
     using ptr = std::shared_ptr<Timer>;
@@ -63,7 +65,7 @@ private:
 
 private:
     std::shared_mutex m_rwMtx;
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
+    std::set<Timer::ptr, Timer::Comparator, PoolAllocator<Timer::ptr>> m_timers; // 定时器对象、控制块和集合节点都从对象池分配
     bool m_isTickled = false; // 是否已经触发过onTimerInsertedAtFront()
     uint64_t m_previouseTime = 0; // 上一次的执行时间
 };
@@ -0,0 +1,167 @@
+#ifndef TTL_CACHE_H
+#define TTL_CACHE_H
+
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include <stdint.h>
+
+#include "timer.h"
+#include "mutex.h"
+#include "singleFlight.h"
+
+namespace KSC {
+
+/**
+ * @brief 按key哈希分片的过期缓存
+ * @details 每个条目写入时在TimerManager上挂一个条件定时器，到期后删除；定时器只持有分片表的弱引用，
+ * 缓存销毁后到期的定时器什么也不做。getOrLoad未命中时通过SingleFlight加载，同一个key并发未命中只回源一次，
+ * 加载结果先写入缓存再唤醒等待者，所以每个TTL周期内热点key最多回源一次
+ */
+template<class K, class V, class Hash = std::hash<K>>
+class TtlCache {
+public:
+    /**
+     * @param ttlMs 条目存活时间（毫秒）
+     * @param timers 负责到期删除的定时器管理器，通常为IOManager，为空时条目不会过期
+     * @param shards 分片数量
+     */
+    TtlCache(uint64_t ttlMs, TimerManager *timers, size_t shards = 16)
+        : m_ttlMs(ttlMs)
+        , m_timers(timers)
+        , m_table(std::make_shared<Table>(shards ? shards : 1)) {}
+
+    ~TtlCache() {
+        for (size_t i = 0; i < m_table->count; i++) {
+            Shard &shard = m_table->shards[i];
+            adaptive_lock lck(shard.mtx);
+            for (auto &it : shard.entries) {
+                if (it.second.timer) {
+                    it.second.timer->cancel();
+                }
+            }
+        }
+    }
+
+    bool get(const K &key, V &out) {
+        Shard &shard = shardOf(key);
+        adaptive_lock lck(shard.mtx);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            return false;
+        }
+        out = it->second.value;
+        return true;
+    }
+
+    void put(const K &key, V value) {
+        Shard &shard = shardOf(key);
+        adaptive_lock lck(shard.mtx);
+        Entry &entry = shard.entries[key];
+        if (entry.timer) {
+            entry.timer->cancel();
+        }
+        entry.value = std::move(value);
+        entry.version = ++shard.version;
+        entry.timer = nullptr;
+        if (m_timers) {
+            Shard *raw = &shard;
+            uint64_t version = entry.version;
+            entry.timer = m_timers->addConditionalTimer(m_ttlMs, [raw, key, version]() {
+                adaptive_lock lck(raw->mtx);
+                auto it = raw->entries.find(key);
+                // 条目在取消定时器之前被覆盖时，旧定时器可能仍会触发，用版本号区分
+                if (it != raw->entries.end() && it->second.version == version) {
+                    raw->entries.erase(it);
+                }
+            }, m_table);
+        }
+    }
+
+    void erase(const K &key) {
+        Shard &shard = shardOf(key);
+        adaptive_lock lck(shard.mtx);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            if (it->second.timer) {
+                it->second.timer->cancel();
+            }
+            shard.entries.erase(it);
+        }
+    }
+
+    /**
+     * @brief 命中直接返回，未命中时调用loader(key)加载并写入缓存，loader抛出的异常会传给所有等待者
+     * @param loaded 不为空时返回本次调用是否亲自执行了loader
+     */
+    template<class Loader>
+    V getOrLoad(const K &key, Loader &&loader, bool *loaded = nullptr) {
+        V value;
+        if (loaded) {
+            *loaded = false;
+        }
+        if (get(key, value)) {
+            return value;
+        }
+        return shardOf(key).flight.call(key, [&]() {
+            // 上一轮加载刚结束时到达的调用者可能错过了缓存，这里再查一次
+            V cached;
+            if (get(key, cached)) {
+                return cached;
+            }
+            if (loaded) {
+                *loaded = true;
+            }
+            V fresh = loader(key);
+            put(key, fresh);
+            return fresh;
+        });
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < m_table->count; i++) {
+            Shard &shard = m_table->shards[i];
+            adaptive_lock lck(shard.mtx);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+
+    TtlCache(const TtlCache &other) = delete;
+    TtlCache &operator=(const TtlCache &other) = delete;
+
+private:
+    struct Entry {
+        V value;
+        uint64_t version = 0;
+        Timer::ptr timer;
+    };
+
+    struct Shard {
+        adaptive_mutex mtx;
+        std::unordered_map<K, Entry, Hash> entries;
+        uint64_t version = 0;
+        SingleFlight<K, V, Hash> flight;
+    };
+
+    // 分片表由定时器通过弱引用访问，单独用共享指针管理
+    struct Table {
+        explicit Table(size_t n) : count(n), shards(new Shard[n]) {}
+        size_t count;
+        std::unique_ptr<Shard[]> shards;
+    };
+
+    Shard &shardOf(const K &key) const {
+        return m_table->shards[Hash()(key) % m_table->count];
+    }
+
+private:
+    uint64_t m_ttlMs;
+    TimerManager *m_timers;
+    std::shared_ptr<Table> m_table;
+};
+
+};
+
+#endif // TTL_CACHE_H
@@ -16,6 +16,17 @@ uint64_t GetDoroutineId();
 
 uint64_t GetElapsedMS();
 
+uint64_t GetElapsedUS();
+
+// 把当前线程绑定到指定CPU，成功返回true
+bool SetThreadAffinity(int cpu);
+
+// 取得CPU所在的NUMA节点，读取/sys失败时返回-1
+int GetCpuNumaNode(int cpu);
+
+// 让当前线程之后的内存分配优先落在指定NUMA节点上，成功返回true
+bool SetThreadPreferredNode(int node);
+
 };
 
 
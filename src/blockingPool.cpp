@@ -0,0 +1,74 @@
+#include "blockingPool.h"
+#include "util.h"
+
+namespace KSC {
+
+BlockingPool::BlockingPool(size_t maxThreads)
+    : m_maxThreads(maxThreads ? maxThreads : 1) {
+}
+
+BlockingPool::~BlockingPool() {
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+        m_stopping = true;
+    }
+    m_cond.notify_all();
+    for (auto &t : m_threads) {
+        t.join();
+    }
+}
+
+void BlockingPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+        m_tasks.push_back(std::move(task));
+        // 没有空闲线程时按需创建，直到上限，之后的任务排队
+        if (m_idle < m_tasks.size() && m_threads.size() < m_maxThreads) {
+            m_threads.emplace_back(&BlockingPool::work, this);
+        }
+    }
+    m_cond.notify_one();
+}
+
+size_t BlockingPool::threadCount() {
+    std::lock_guard<std::mutex> lck(m_mtx);
+    return m_threads.size();
+}
+
+size_t BlockingPool::busyCount() {
+    std::lock_guard<std::mutex> lck(m_mtx);
+    return m_threads.size() - m_idle;
+}
+
+size_t BlockingPool::queueDepth() {
+    std::lock_guard<std::mutex> lck(m_mtx);
+    return m_tasks.size();
+}
+
+BlockingPool *BlockingPool::GetInstance() {
+    // 进程退出时可能还有线程阻塞在系统调用里，不析构，避免join卡住退出
+    static BlockingPool *instance = new BlockingPool;
+    return instance;
+}
+
+void BlockingPool::work() {
+    KSC::SetThreadName("blocking");
+    std::unique_lock<std::mutex> lck(m_mtx);
+    while (true) {
+        ++m_idle;
+        m_cond.wait(lck, [this]() { return m_stopping || !m_tasks.empty(); });
+        --m_idle;
+        if (m_tasks.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lck.unlock();
+        task();
+        task = nullptr;
+        m_completed.fetch_add(1, std::memory_order_relaxed);
+        lck.lock();
+    }
+}
+
+};
@@ -1,9 +1,12 @@
 #include <atomic>
 #include <thread>
+#include <algorithm>
+#include <iterator>
 
 #include "log.h"
 #include "doroutine.h"
 #include "scheduler.h"
+#include "util.h"
 
 namespace KSC {
 
@@ -14,6 +17,58 @@ static std::atomic<uint64_t> s_doroutineCount {0};
 
 static thread_local Doroutine::ptr st_threadCurdoroutine = nullptr;
 static thread_local Doroutine::ptr st_threadMainDoroutine = nullptr;
+static std::atomic<size_t> s_localSlotCount {0};
+
+void LocalSlots::set(size_t index, void *value, void (*destroy)(void *)) {
+    Slot *slot = slotAt(index);
+    void *old = slot->value;
+    void (*oldDestroy)(void *) = slot->destroy;
+    slot->value = value;
+    slot->destroy = destroy;
+    if (old && oldDestroy) {
+        oldDestroy(old);
+    }
+}
+
+void LocalSlots::clear() {
+    // 析构函数可能读取其他协程局部变量，先摘下再析构
+    for (size_t i = 0; i < INLINE_SLOTS + m_overflowSize; i++) {
+        Slot *slot = i < INLINE_SLOTS ? &m_inline[i] : &m_overflow[i - INLINE_SLOTS];
+        if (slot->value) {
+            void *value = slot->value;
+            void (*destroy)(void *) = slot->destroy;
+            slot->value = nullptr;
+            slot->destroy = nullptr;
+            destroy(value);
+        }
+    }
+    delete[] m_overflow;
+    m_overflow = nullptr;
+    m_overflowSize = 0;
+}
+
+size_t LocalSlots::AllocIndex() {
+    return s_localSlotCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+LocalSlots::Slot *LocalSlots::slotAt(size_t index) {
+    if (index < INLINE_SLOTS) {
+        return &m_inline[index];
+    }
+    index -= INLINE_SLOTS;
+    if (index >= m_overflowSize) {
+        // 按已分配的下标总数扩容，之后新建的key才会再次触发
+        size_t size = std::max(index + 1, s_localSlotCount.load(std::memory_order_relaxed) - INLINE_SLOTS);
+        Slot *overflow = new Slot[size];
+        for (size_t i = 0; i < m_overflowSize; i++) {
+            overflow[i] = m_overflow[i];
+        }
+        delete[] m_overflow;
+        m_overflow = overflow;
+        m_overflowSize = size;
+    }
+    return &m_overflow[index];
+}
 
 Doroutine::Doroutine() {
     m_state = RUNNING;
@@ -33,7 +88,9 @@ Doroutine::Doroutine(std::function<void()> func, size_t stackSize, bool runInSch
     , m_runInScheduler(runInScheduler) {
     
     m_stackSize = stackSize ? stackSize : 1024 * 128;
-    m_stack = StackAllocator::Alloc(m_stackSize);
+    // 栈顶之后多分配一段作为分配器的第一块，栈向低地址增长，溢出时碰不到它；不使用分配器时这段内存不会被访问
+    m_stack = StackAllocator::Alloc(m_stackSize + ARENA_INLINE_SIZE);
+    m_arena.setInlineChunk((char *)m_stack + m_stackSize, ARENA_INLINE_SIZE);
 
     if (getcontext(&m_ctx)) {
         SYLAR_LOG_ERROR(g_logger) << "getcontext wrong!";
@@ -61,6 +118,7 @@ Doroutine::~Doroutine() {
 void Doroutine::resume() {
     SetThis(shared_from_this()); // 切换到当前协程
     m_state = RUNNING;
+    m_lastThread.store(GetThreadId(), std::memory_order_relaxed);
     
     if (m_runInScheduler) {
         // 和调度器的主协程进行切换
@@ -69,13 +127,30 @@ void Doroutine::resume() {
         // 和当前线程的主协程进行切换
         swapcontext(&(st_threadMainDoroutine->m_ctx), &m_ctx);
     }
+
+    // 回到这里说明协程已经yield并且上下文保存完毕，此时才允许其他线程再次resume它
+    // 协程在工作函数终止后也会yield一次用于回到主协程，此时状态保持TERM
+    State running = RUNNING;
+    m_state.compare_exchange_strong(running, READY, std::memory_order_release);
+}
+
+bool Doroutine::maybeYield() {
+    if (!Scheduler::PreemptRequested()) {
+        return false;
+    }
+    Doroutine::ptr cur = GetThis();
+    size_t bucket = 0;
+    if (!Scheduler::RequeuePreempted(cur, bucket)) {
+        return false;
+    }
+    ++cur->m_preemptCount;
+    ++cur->m_overrunHistogram[bucket];
+    cur->yield();
+    return true;
 }
 
 void Doroutine::yield() {
     SetThis(st_threadMainDoroutine);
-    if (m_state != TERM) { // 协程在工作函数终止后也会yield一次用于回到主协程
-        m_state = READY;
-    }
     if (m_runInScheduler) {
         // 和调度器的主协程进行切换
         swapcontext(&m_ctx, &(Scheduler::GetMainDoroutine()->m_ctx));
@@ -95,6 +170,12 @@ void Doroutine::reset(std::function<void()> func) {
     }
 
     m_func = func;
+    m_priority.store(-1, std::memory_order_relaxed);
+    // 复用的协程执行的是新任务，抢占统计重新开始
+    m_preemptCount = 0;
+    std::fill(std::begin(m_overrunHistogram), std::end(m_overrunHistogram), 0);
+    m_locals.clear();
+    m_arena.release();
 
     getcontext(&m_ctx);
 
@@ -119,6 +200,21 @@ Doroutine::ptr Doroutine::GetMainThis()
     return st_threadMainDoroutine;
 }
 
+LocalSlots &Doroutine::CurrentLocals() {
+    static thread_local LocalSlots st_threadLocals;
+    if (st_threadCurdoroutine) {
+        return st_threadCurdoroutine->m_locals;
+    }
+    return st_threadLocals;
+}
+
+std::pmr::memory_resource *Doroutine::CurrentArena() {
+    if (st_threadCurdoroutine && st_threadCurdoroutine->m_stack) {
+        return &st_threadCurdoroutine->m_arena;
+    }
+    return std::pmr::new_delete_resource();
+}
+
 uint64_t Doroutine::GetThisId() {
     if (st_threadCurdoroutine) {
         return st_threadCurdoroutine->getId();
@@ -131,6 +227,9 @@ void Doroutine::WorkFunc() {
 
     curDoroutine->m_func();
     curDoroutine->m_func = nullptr;
+    // 局部变量的析构函数在协程自己的上下文里执行，它们可能用到分配器，所以先于分配器释放
+    curDoroutine->m_locals.clear();
+    curDoroutine->m_arena.release();
     curDoroutine->m_state = TERM;
 
     auto rawPtr = curDoroutine.get();
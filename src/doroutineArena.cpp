@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include <algorithm>
+
+#include "doroutineArena.h"
+
+namespace KSC {
+
+static inline char *alignUp(char *p, size_t alignment) {
+    return (char *)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void DoroutineArena::setInlineChunk(void *chunk, size_t size) {
+    m_inline = (char *)chunk;
+    m_inlineSize = chunk ? size : 0;
+    m_cur = m_inline;
+    m_end = m_inline + m_inlineSize;
+}
+
+void DoroutineArena::release() {
+    while (m_chunks) {
+        Chunk *next = m_chunks->next;
+        free(m_chunks);
+        m_chunks = next;
+    }
+    m_cur = m_inline;
+    m_end = m_inline + m_inlineSize;
+    m_nextChunkSize = PAGE_SIZE;
+    m_allocated = 0;
+    m_heapChunks = 0;
+}
+
+void *DoroutineArena::do_allocate(size_t bytes, size_t alignment) {
+    char *p = alignUp(m_cur, alignment);
+    if (m_cur && p + bytes <= m_end) {
+        m_cur = p + bytes;
+        m_allocated += bytes;
+        return p;
+    }
+    return allocateSlow(bytes, alignment);
+}
+
+void *DoroutineArena::allocateSlow(size_t bytes, size_t alignment) {
+    // 新块按页取整，放得下本次请求（含块头和对齐的余量），否则按翻倍后的大小
+    size_t need = sizeof(Chunk) + bytes + alignment;
+    size_t size = std::max(m_nextChunkSize, (need + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+    Chunk *chunk = (Chunk *)malloc(size);
+    if (!chunk) {
+        throw std::bad_alloc();
+    }
+    chunk->next = m_chunks;
+    chunk->size = size;
+    m_chunks = chunk;
+    ++m_heapChunks;
+    m_nextChunkSize = std::min(m_nextChunkSize * 2, MAX_CHUNK);
+
+    // 旧块剩下的空间直接丢弃，碰撞分配只往前走
+    m_cur = (char *)(chunk + 1);
+    m_end = (char *)chunk + size;
+    char *p = alignUp(m_cur, alignment);
+    m_cur = p + bytes;
+    m_allocated += bytes;
+    return p;
+}
+
+};
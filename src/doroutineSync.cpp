@@ -0,0 +1,351 @@
+#include "doroutineSync.h"
+#include "iomanager.h"
+
+namespace KSC {
+
+Scheduler *WaitNode::CurrentScheduler() {
+    Scheduler *sc = Scheduler::GetThis();
+    if (!sc) {
+        return nullptr;
+    }
+    // 只有调度器里运行的子协程可以yield挂起，线程主协程只能阻塞整个线程
+    Doroutine::ptr cur = Doroutine::GetThis();
+    if (cur && cur != Doroutine::GetMainThis() && cur.get() != Scheduler::GetMainDoroutine()) {
+        return sc;
+    }
+    return nullptr;
+}
+
+void WaitNode::prepare() {
+    Scheduler *sc = CurrentScheduler();
+    if (sc) {
+        doroutine = Doroutine::GetThis();
+        scheduler = sc;
+    } else {
+        doroutine = nullptr;
+        scheduler = nullptr;
+    }
+    signaled.store(0, std::memory_order_relaxed);
+    queued = false;
+    prev = next = nullptr;
+}
+
+void WaitNode::park() {
+    if (doroutine) {
+        // 唤醒方可能在yield完成之前就把协程放回了任务队列，调度器会等它真正让出后才resume
+        Doroutine::GetThis()->yield();
+        return;
+    }
+    while (signaled.load(std::memory_order_acquire) == 0) {
+        futex_wait(&signaled, 0);
+    }
+}
+
+void WaitNode::wake(int thread) {
+    if (doroutine) {
+        // 不能把doroutine移走，等待者可能还没走到park，仍要靠它判断挂起方式
+        Scheduler *sc = scheduler;
+        Doroutine::ptr d = doroutine;
+        sc->schedule(d, thread);
+        return;
+    }
+    signaled.store(1, std::memory_order_release);
+    futex_wake(&signaled, 1);
+}
+
+void WaitQueue::push(WaitNode *node) {
+    node->next = nullptr;
+    node->prev = m_tail;
+    if (m_tail) {
+        m_tail->next = node;
+    } else {
+        m_head = node;
+    }
+    m_tail = node;
+    node->queued = true;
+    ++m_size;
+}
+
+WaitNode *WaitQueue::pop() {
+    WaitNode *node = m_head;
+    if (node) {
+        remove(node);
+    }
+    return node;
+}
+
+void WaitQueue::remove(WaitNode *node) {
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        m_head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        m_tail = node->prev;
+    }
+    node->prev = node->next = nullptr;
+    node->queued = false;
+    --m_size;
+}
+
+void WaitQueue::swap(WaitQueue &other) {
+    std::swap(m_head, other.m_head);
+    std::swap(m_tail, other.m_tail);
+    std::swap(m_size, other.m_size);
+}
+
+void DoroutineMutex::lockSlow() {
+    WaitNode node;
+    node.prepare();
+    {
+        ticket_lock lck(m_mtx);
+        if (m_pendingHandoffs) {
+            --m_pendingHandoffs;
+            return;
+        }
+        m_waiters.push(&node);
+    }
+    node.park(); // 醒来时锁已经交到自己手上
+}
+
+void DoroutineMutex::unlockSlow() {
+    WaitNode *node;
+    {
+        ticket_lock lck(m_mtx);
+        node = m_waiters.pop();
+        if (!node) {
+            ++m_pendingHandoffs;
+            return;
+        }
+    }
+    node->wake();
+}
+
+void DoroutineSemaphore::waitSlow() {
+    WaitNode node;
+    node.prepare();
+    {
+        ticket_lock lck(m_mtx);
+        if (m_pendingHandoffs) {
+            --m_pendingHandoffs;
+            return;
+        }
+        m_waiters.push(&node);
+    }
+    node.park();
+}
+
+void DoroutineSemaphore::notifySlow() {
+    WaitNode *node;
+    {
+        ticket_lock lck(m_mtx);
+        node = m_waiters.pop();
+        if (!node) {
+            ++m_pendingHandoffs;
+            return;
+        }
+    }
+    node->wake();
+}
+
+void DoroutineConditionVariable::wait(DoroutineMutex &mtx) {
+    WaitNode node;
+    node.prepare();
+    {
+        // 先入队再解锁，保证持锁修改条件后的notify一定能看到这个等待者
+        ticket_lock lck(m_mtx);
+        m_waiters.push(&node);
+        m_waiterCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    mtx.unlock();
+    node.park();
+    mtx.lock();
+}
+
+void DoroutineConditionVariable::notifyOne() {
+    if (m_waiterCount.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    WaitNode *node;
+    {
+        ticket_lock lck(m_mtx);
+        node = m_waiters.pop();
+        if (!node) {
+            return;
+        }
+        m_waiterCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+    node->wake();
+}
+
+void DoroutineConditionVariable::notifyAll() {
+    if (m_waiterCount.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    WaitQueue waiters;
+    {
+        ticket_lock lck(m_mtx);
+        waiters.swap(m_waiters);
+        m_waiterCount.store(0, std::memory_order_relaxed);
+    }
+    while (WaitNode *node = waiters.pop()) {
+        node->wake();
+    }
+}
+
+bool WaitGroup::waitFor(uint64_t timeoutMs) {
+    if (m_count.load(std::memory_order_acquire) <= 0) {
+        return true;
+    }
+    auto waiter = std::make_shared<Waiter>();
+    waiter->prepare();
+    {
+        adaptive_lock lck(m_mtx);
+        // 在锁内复查，最后一个done()在计数归零之后才会加锁唤醒，这里要么看到归零要么会被唤醒
+        if (m_count.load(std::memory_order_acquire) <= 0) {
+            return true;
+        }
+        m_waiters.push(waiter.get());
+    }
+
+    Timer::ptr timer;
+    IOManager *iom = timeoutMs == WAIT_FOREVER ? nullptr : IOManager::GetThis();
+    if (iom) {
+        Waiter *raw = waiter.get();
+        timer = iom->addConditionalTimer(timeoutMs, [this, raw]() {
+            int expected = WAITING;
+            if (!raw->state.compare_exchange_strong(expected, TIMEOUT, std::memory_order_acq_rel)) {
+                return;
+            }
+            // 抢到了唤醒权说明等待者还挂着，WaitGroup此时一定还活着
+            {
+                adaptive_lock lck(m_mtx);
+                if (raw->queued) {
+                    m_waiters.remove(raw);
+                }
+            }
+            raw->wake();
+        }, waiter);
+    }
+
+    waiter->park();
+    if (timer) {
+        timer->cancel();
+    }
+    return waiter->state.load(std::memory_order_acquire) == WOKEN;
+}
+
+void WaitGroup::wakeAll() {
+    std::vector<Waiter *> woken;
+    {
+        adaptive_lock lck(m_mtx);
+        while (WaitNode *node = m_waiters.pop()) {
+            Waiter *waiter = static_cast<Waiter *>(node);
+            int expected = WAITING;
+            if (waiter->state.compare_exchange_strong(expected, WOKEN, std::memory_order_acq_rel)) {
+                woken.push_back(waiter);
+            }
+        }
+    }
+    for (Waiter *waiter : woken) {
+        waiter->wake();
+    }
+}
+
+void DoroutineRWMutex::rdlockSlow() {
+    WaitNode node;
+    node.prepare();
+    {
+        ticket_lock lck(m_mtx);
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(s & WRITER) && m_writers.empty()) {
+                if (m_state.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+                    return;
+                }
+                continue;
+            }
+            if (m_state.compare_exchange_weak(s, s | WAITERS, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        m_readers.push(&node);
+    }
+    node.park(); // 唤醒方已经替我们计入了读者数
+}
+
+void DoroutineRWMutex::wrlockSlow() {
+    WaitNode node;
+    node.prepare();
+    {
+        ticket_lock lck(m_mtx);
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(s & WRITER) && (s & READERS_MASK) == 0) {
+                if (m_state.compare_exchange_weak(s, WRITER | (s & WAITERS), std::memory_order_acquire)) {
+                    return;
+                }
+                continue;
+            }
+            if (m_state.compare_exchange_weak(s, s | WAITERS, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        m_writers.push(&node);
+    }
+    node.park();
+}
+
+/**
+ * 等待位置位后快路径的CAS都会失败，所以下面可以在锁内直接store状态
+ */
+void DoroutineRWMutex::rdunlockSlow() {
+    WaitNode *writer = nullptr;
+    {
+        ticket_lock lck(m_mtx);
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        if (!(s & WAITERS)) {
+            m_state.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        if ((s & READERS_MASK) == 1 && !m_writers.empty()) {
+            writer = m_writers.pop();
+            bool waiting = !m_writers.empty() || !m_readers.empty();
+            m_state.store(WRITER | (waiting ? WAITERS : 0), std::memory_order_release);
+        } else {
+            m_state.store(s - 1, std::memory_order_release);
+        }
+    }
+    if (writer) {
+        writer->wake();
+    }
+}
+
+void DoroutineRWMutex::wrunlockSlow() {
+    WaitQueue readers;
+    WaitNode *writer = nullptr;
+    {
+        ticket_lock lck(m_mtx);
+        if (!m_readers.empty()) {
+            readers.swap(m_readers);
+            uint32_t waiting = m_writers.empty() ? 0 : WAITERS;
+            m_state.store((uint32_t)readers.size() | waiting, std::memory_order_release);
+        } else if (!m_writers.empty()) {
+            writer = m_writers.pop();
+            uint32_t waiting = m_writers.empty() ? 0 : WAITERS;
+            m_state.store(WRITER | waiting, std::memory_order_release);
+        } else {
+            m_state.store(0, std::memory_order_release);
+        }
+    }
+    while (WaitNode *node = readers.pop()) {
+        node->wake();
+    }
+    if (writer) {
+        writer->wake();
+    }
+}
+
+};
@@ -46,6 +46,7 @@ bool FdCtx::init() {
     } else {
         m_isInit = true;
         m_isSocket = S_ISSOCK(fdStat.st_mode);
+        m_isRegular = S_ISREG(fdStat.st_mode);
     }
 
     if(m_isSocket) {
@@ -1,4 +1,5 @@
 #include <dlfcn.h>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <stdarg.h>
@@ -7,6 +8,7 @@
 #include "doroutine.h"
 #include "iomanager.h"
 #include "fdManager.h"
+#include "blockingPool.h"
 #include "hook.h"
 
 namespace KSC {
@@ -33,6 +35,10 @@ static thread_local bool st_hookEnable = false;
     XX(sendto) \
     XX(sendmsg) \
     XX(close) \
+    XX(open) \
+    XX(pread) \
+    XX(pwrite) \
+    XX(fsync) \
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
@@ -89,12 +95,19 @@ static ssize_t do_io(int fd, originFunc fun, const char* hook_fun_name,
         return -1;
     }
 
+    // 普通文件的读写不会返回EAGAIN，epoll也不支持，只能交给阻塞线程池，让出当前工作线程
+    if (ctx->isRegularFile()) {
+        return KSC::offload([&]() {
+            return fun(fd, args...);
+        });
+    }
+
     if (!ctx->isSocket() || ctx->getUserNonblock()) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<timerInfo> tinfo = std::make_shared<timerInfo>();
+    std::shared_ptr<timerInfo> tinfo = std::allocate_shared<timerInfo>(KSC::PoolAllocator<timerInfo>()); // 每次I/O调用都要一个，从对象池分配
 
 retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -133,7 +146,7 @@ retry:
             if (timer) {
                 timer->cancel();
             }
-            SYLAR_LOG_ERROR(KSC::g_logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ") wrong";
+            SYLAR_LOG_RATE_LIMITED(KSC::g_logger, sylar::LogLevel::ERROR, 10, 10) << hook_fun_name << " addEvent(" << fd << ", " << event << ") wrong";
         }
     }
     return n;
@@ -152,8 +165,8 @@ unsigned int sleep(unsigned int seconds) {
     KSC::Doroutine::ptr doroutine = KSC::Doroutine::GetThis();
     KSC::IOManager *iom = KSC::IOManager::GetThis();
 
-    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
-    iom->addTimer(seconds * 1000, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1));
+    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int, KSC::Scheduler::Priority); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
+    iom->addTimer(seconds * 1000, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1, KSC::Scheduler::PRIORITY_DEFAULT));
 
     KSC::Doroutine::GetThis()->yield();
     return 0;
@@ -167,8 +180,8 @@ int usleep(useconds_t usec) {
     KSC::Doroutine::ptr doroutine = KSC::Doroutine::GetThis();
     KSC::IOManager *iom = KSC::IOManager::GetThis();
 
-    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
-    iom->addTimer(usec / 1000, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1));
+    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int, KSC::Scheduler::Priority); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
+    iom->addTimer(usec / 1000, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1, KSC::Scheduler::PRIORITY_DEFAULT));
 
     KSC::Doroutine::GetThis()->yield();
     return 0;
@@ -183,8 +196,8 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
     KSC::Doroutine::ptr doroutine = KSC::Doroutine::GetThis();
     KSC::IOManager *iom = KSC::IOManager::GetThis();
 
-    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
-    iom->addTimer(timeoutMs, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1));
+    using schedulePtr = void(KSC::Scheduler::*)(KSC::Doroutine::ptr, int, KSC::Scheduler::Priority); // 由于schedule是模板函数，因此此处要特化模板后才能进行bind
+    iom->addTimer(timeoutMs, std::bind((schedulePtr)&KSC::IOManager::schedule, iom, doroutine, -1, KSC::Scheduler::PRIORITY_DEFAULT));
 
     KSC::Doroutine::GetThis()->yield();
     return 0;
@@ -230,7 +243,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 
     KSC::IOManager *iom = KSC::IOManager::GetThis();
     KSC::Timer::ptr timer;
-    std::shared_ptr<timerInfo> tinfo = std::make_shared<timerInfo>();
+    std::shared_ptr<timerInfo> tinfo = std::allocate_shared<timerInfo>(KSC::PoolAllocator<timerInfo>());
     std::weak_ptr<timerInfo> winfo(tinfo);
 
     if (timeout_ms != (uint64_t)-1) {
@@ -266,7 +279,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         if (timer) {
             timer->cancel();
         }
-        SYLAR_LOG_DEBUG(KSC::g_logger) << "connect addEvent(" << fd << ", WRITE) error" << std::endl;
+        SYLAR_LOG_RATE_LIMITED(KSC::g_logger, sylar::LogLevel::DEBUG, 10, 10) << "connect addEvent(" << fd << ", WRITE) error" << std::endl;
     }
 
     int error = 0;
@@ -287,6 +300,30 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
+    KSC::IOManager *iom = KSC::IOManager::GetThis();
+    if (KSC::st_hookEnable && iom && iom->isOverloaded()) {
+        // 调度器过载时暂停接受新连接，让连接留在内核的积压队列里，先把已经接受的请求处理完
+        KSC::FdCtx::ptr ctx = KSC::FdManager::GetInstance()->get(s);
+        if (ctx && ctx->isSocket() && !ctx->isClose()) {
+            if (ctx->getUserNonblock()) {
+                // 用户自己设置的非阻塞监听套接字由事件循环驱动，不能睡在这里，当作暂时没有连接
+                errno = EAGAIN;
+                return -1;
+            }
+            // 等待不超过SO_RCVTIMEO，超时和阻塞accept一样返回ETIMEDOUT
+            uint64_t timeout = ctx->getTimeout(SO_RCVTIMEO);
+            uint64_t step = std::max<uint64_t>(1000, iom->getOptions().codelIntervalUs);
+            uint64_t begin = KSC::GetElapsedUS();
+            while (iom->isOverloaded()) {
+                uint64_t waited = KSC::GetElapsedUS() - begin;
+                if (timeout != (uint64_t)-1 && waited >= timeout * 1000) {
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+                usleep((useconds_t)(timeout == (uint64_t)-1 ? step : std::min(step, timeout * 1000 - waited)));
+            }
+        }
+    }
     int fd = do_io(s, accept_f, "accept", KSC::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
     if (fd >= 0) {
         KSC::FdManager::GetInstance()->get(fd, true);
@@ -350,6 +387,64 @@ int close(int fd) {
     return close_f(fd);
 }
 
+int open(const char *pathname, int flags, ...) {
+    mode_t mode = 0;
+    // O_TMPFILE包含O_DIRECTORY位，只有完整的O_TMPFILE才带mode参数，和glibc的判断一致
+    if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    if (!KSC::st_hookEnable) {
+        return open_f(pathname, flags, mode);
+    }
+
+    int fd = KSC::offload([&]() {
+        return open_f(pathname, flags, mode);
+    });
+    if (fd >= 0) {
+        // 记录下来，之后对普通文件的读写才知道要交给阻塞线程池
+        KSC::FdManager::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    if (!KSC::st_hookEnable) {
+        return pread_f(fd, buf, count, offset);
+    }
+    KSC::FdCtx::ptr ctx = KSC::FdManager::GetInstance()->get(fd);
+    if (!ctx || !ctx->isRegularFile()) {
+        return pread_f(fd, buf, count, offset);
+    }
+    return KSC::offload([&]() {
+        return pread_f(fd, buf, count, offset);
+    });
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    if (!KSC::st_hookEnable) {
+        return pwrite_f(fd, buf, count, offset);
+    }
+    KSC::FdCtx::ptr ctx = KSC::FdManager::GetInstance()->get(fd);
+    if (!ctx || !ctx->isRegularFile()) {
+        return pwrite_f(fd, buf, count, offset);
+    }
+    return KSC::offload([&]() {
+        return pwrite_f(fd, buf, count, offset);
+    });
+}
+
+int fsync(int fd) {
+    if (!KSC::st_hookEnable) {
+        return fsync_f(fd);
+    }
+    return KSC::offload([&]() {
+        return fsync_f(fd);
+    });
+}
+
 int fcntl(int fd, int cmd, ... /* arg */ ) {
     va_list va;
     va_start(va, cmd);
@@ -6,6 +6,7 @@
 
 #include "log.h"
 #include "iomanager.h"
+#include "util.h"
 
 namespace KSC {
 
@@ -36,20 +37,23 @@ void IOManager::FdContext::triggerEvent(Event event, bool lastTrigger) {
     }
 
     EventContext &ctx = getEventContext(event);
+    IOManager *iom = IOManager::GetThis();
     if (ctx.func) {
         ctx.scheduler->schedule(ctx.func);
-    } else {
+    } else if (!(iom->isDirectResume() && ctx.scheduler == iom
+                 && ctx.doroutine->getLastThread() == KSC::GetThreadId()
+                 && iom->scheduleLocal(ctx.doroutine))) {
         ctx.scheduler->schedule(ctx.doroutine);
     }
     if (!ctx.repeat || lastTrigger) {
-        IOManager::GetThis()->decPendingEventCount();
+        iom->decPendingEventCount();
         events = (Event)(events & ~event);
         resetEventContext(ctx);
     }
 }
 
-IOManager::IOManager(size_t threads, bool userCaller, const std::string &name) 
-    : Scheduler(threads, userCaller, name) {
+IOManager::IOManager(size_t threads, bool userCaller, const std::string &name, const SchedulerOptions &options) 
+    : Scheduler(threads, userCaller, name, options) {
     
     m_epfd = epoll_create(5000);
     if (m_epfd <= 0) {
@@ -114,7 +118,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> func, bool re
 
     int rt = epoll_ctl(m_epfd, op, fd, &epEvent);
     if (rt == -1) {
-        SYLAR_LOG_DEBUG(g_logger) << "epoll ctl wrong!";
+        SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::DEBUG, 10, 10) << "epoll ctl wrong!";
         return -1;
     }
 
@@ -155,7 +159,7 @@ bool IOManager::delEvent(int fd, Event event) {
 
     int rt = epoll_ctl(m_epfd, op, fd, &epEvent);
     if (rt == -1) {
-        SYLAR_LOG_DEBUG(g_logger) << "epoll ctl wrong!";
+        SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::DEBUG, 10, 10) << "epoll ctl wrong!";
         return false;
     }
 
@@ -189,7 +193,7 @@ bool IOManager::cancelEvent(int fd, Event event) {
 
     int rt = epoll_ctl(m_epfd, op, fd, &epEvent);
     if (rt == -1) {
-        SYLAR_LOG_DEBUG(g_logger) << "epoll ctl wrong!";
+        SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::DEBUG, 10, 10) << "epoll ctl wrong!";
         return false;
     }
 
@@ -218,7 +222,7 @@ bool IOManager::cancelAll(int fd) {
 
     int rt = epoll_ctl(m_epfd, op, fd, &epEvent);
     if (rt == -1) {
-        SYLAR_LOG_DEBUG(g_logger) << "epoll ctl wrong!";
+        SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::DEBUG, 10, 10) << "epoll ctl wrong!";
         return false;
     }
 
@@ -270,6 +274,10 @@ void IOManager::idle() {
             SYLAR_LOG_DEBUG(g_logger) << "idle stop exit";
             break;
         }
+        if (IsRetiring()) {
+            SYLAR_LOG_DEBUG(g_logger) << "idle retire exit";
+            break;
+        }
 
         int rt = 0;
         do {
@@ -280,6 +288,10 @@ void IOManager::idle() {
             } else {
                 nextTimeout = MAX_TIMEOUT;
             }
+            // 弹性模式下空闲线程要定期回到调度循环检查是否该退出
+            if (isElastic()) {
+                nextTimeout = std::min(nextTimeout, getOptions().retireIdleMs);
+            }
             rt = epoll_wait(m_epfd, events, MAX_EVENTS, (int)nextTimeout);
             if(rt < 0 && errno == EINTR) {
                 continue;
@@ -338,7 +350,7 @@ void IOManager::idle() {
 
             int rt2 = epoll_ctl(m_epfd, op, fdCtx->fd, &event);
             if (rt2 == -1) {
-                SYLAR_LOG_DEBUG(g_logger) << "epoll ctl wrong!";
+                SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::DEBUG, 10, 10) << "epoll ctl wrong!";
                 continue;
             }
 
@@ -1,7 +1,14 @@
 #include <functional>
-
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "log.h"
+#include "hook.h"
 
 namespace sylar {
 
@@ -132,25 +139,39 @@ public:
     }
 };
 
+/**
+ * 日志时间戳精度是秒，同一秒内的日志格式化结果相同，缓存上一次的结果，
+ * 缓存读多写少，用顺序锁保护，读的时候不写共享内存
+ */
 class DateTimeFormatItem : public LogFormatter::FormatItem {
 public:
     DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
-        :m_format(format) {
+        :m_format(format)
+        ,m_cache(Cache{-1, {0}}) {
         if(m_format.empty()) {
             m_format = "%Y-%m-%d %H:%M:%S";
         }
     }
 
     void format(std::ostream& os, LogEvent::ptr event) override {
-        struct tm tm;
         time_t time = event->getTime();
-        localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
+        Cache cache = m_cache.load();
+        if(cache.time != time) {
+            struct tm tm;
+            localtime_r(&time, &tm);
+            cache.time = time;
+            strftime(cache.buf, sizeof(cache.buf), m_format.c_str(), &tm);
+            m_cache.store(cache);
+        }
+        os << cache.buf;
     }
 private:
+    struct Cache {
+        time_t time;
+        char buf[64];
+    };
     std::string m_format;
+    KSC::seq_locked<Cache> m_cache;
 };
 
 class FileNameFormatItem : public LogFormatter::FormatItem {
@@ -372,17 +393,17 @@ std::ostream &LogFormatter::format(std::ostream &os, LogEvent::ptr event) {
 }
 
 LogAppender::LogAppender(LogFormatter::ptr default_formatter)
-    : m_defaultFormatter(default_formatter) {
+    : m_formatter(new LogFormatter::ptr(default_formatter))
+    , m_defaultFormatter(default_formatter) {
 }
 
 void LogAppender::setFormatter(LogFormatter::ptr val) {
-    KSC::spin_lock lock(m_mutex);
-    m_formatter = val;
+    m_formatter.store(new LogFormatter::ptr(val ? val : m_defaultFormatter));
 }
 
 LogFormatter::ptr LogAppender::getFormatter() {
-    KSC::spin_lock lock(m_mutex);
-    return m_formatter ? m_formatter : m_defaultFormatter;
+    KSC::RcuReadGuard guard;
+    return *m_formatter.load();
 }
 
 StdoutLogAppender::StdoutLogAppender()
@@ -390,11 +411,7 @@ StdoutLogAppender::StdoutLogAppender()
 }
 
 void StdoutLogAppender::log(LogEvent::ptr event) {
-    if(m_formatter) {
-        m_formatter->format(std::cout, event);
-    } else {
-        m_defaultFormatter->format(std::cout, event);
-    }
+    getFormatter()->format(std::cout, event);
 }
 
 FileLogAppender::FileLogAppender(const std::string &file)
@@ -421,21 +438,18 @@ void FileLogAppender::log(LogEvent::ptr event) {
     if(m_reopenError) {
         return;
     }
-    KSC::spin_lock lock(m_mutex);
-    if(m_formatter) {
-        if(!m_formatter->format(m_filestream, event)) {
-            std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
-        }
-    } else {
-        if(!m_defaultFormatter->format(m_filestream, event)) {
-            std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
-        }
+    LogFormatter::ptr formatter = getFormatter();
+    KSC::adaptive_lock lock(m_mutex);
+    if(!formatter->format(m_filestream, event)) {
+        std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
     }
-    
+
 }
 
 bool FileLogAppender::reopen() {
-    KSC::spin_lock lock(m_mutex);
+    // 持有自旋锁期间打开文件，不能被hook挂起协程
+    KSC::HookEnableGuard hook(false);
+    KSC::adaptive_lock lock(m_mutex);
     if(m_filestream) {
         m_filestream.close();
     }
@@ -444,30 +458,211 @@ bool FileLogAppender::reopen() {
     return !m_reopenError;
 }
 
+RotatingFileLogAppender::RotatingFileLogAppender(const std::string &file, size_t max_size
+        , uint64_t interval, size_t retention)
+    : LogAppender(LogFormatter::ptr(new LogFormatter))
+    , m_filename(file)
+    , m_interval(interval)
+    , m_retention(retention) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    m_maxSize = (std::max(max_size, page) + page - 1) / page * page;
+    KSC::HookEnableGuard hook(false);
+    KSC::adaptive_lock lock(m_mutex);
+    tryOpenSegment(time(0));
+}
+
+RotatingFileLogAppender::~RotatingFileLogAppender() {
+    KSC::HookEnableGuard hook(false);
+    KSC::adaptive_lock lock(m_mutex);
+    closeSegment();
+}
+
+/**
+ * 格式化在锁外完成，持锁期间只做滚动判断和一次memcpy
+ *
+ * 单条日志超过整个段大小时会被截断；空段不会因为大小滚动，否则每条超长日志都会把一个空段挤进历史段，淘汰掉真正的旧段
+ */
+void RotatingFileLogAppender::log(LogEvent::ptr event) {
+    std::string str = getFormatter()->format(event);
+    time_t now = event->getTime();
+
+    KSC::adaptive_lock lock(m_mutex);
+    bool reopen = m_reopenRequested.exchange(false, std::memory_order_relaxed);
+    if(reopen) {
+        closeSegment();
+    }
+    if(m_fd == -1 && (reopen || now >= m_retryTime)) {
+        // 上次打开失败（或写入失败关闭了段）后，按重试间隔由后续日志再试
+        tryOpenSegment(now);
+    }
+    if(m_fd != -1 && ((m_interval && (uint64_t)now >= m_openTime + m_interval)
+            || (m_offset > 0 && m_offset + str.size() > m_maxSize))) {
+        closeSegment();
+        shiftSegments();
+        tryOpenSegment(now);
+    }
+    if(m_fd == -1) {
+        return;
+    }
+    size_t len = std::min(str.size(), m_maxSize - m_offset);
+    if(m_base) {
+        memcpy(m_base + m_offset, str.data(), len);
+        m_offset += len;
+        return;
+    }
+    ssize_t n = pwrite(m_fd, str.data(), len, m_offset);
+    if(n == -1) {
+        std::cout << "[ERROR] RotatingFileLogAppender write " << m_filename << " error: " << strerror(errno) << std::endl;
+        closeSegment();
+        m_retryTime = now + RETRY_INTERVAL;
+        return;
+    }
+    m_offset += n;
+}
+
+/**
+ * 持锁期间的open/ftruncate/close如果被hook交给阻塞线程池，协程会带着锁挂起，
+ * 同一工作线程上的下一条日志就会在锁上阻塞整个线程，挂起的协程再也得不到恢复，所以和Logger::log一样关掉hook
+ */
+bool RotatingFileLogAppender::rotate() {
+    KSC::HookEnableGuard hook(false);
+    KSC::adaptive_lock lock(m_mutex);
+    closeSegment();
+    shiftSegments();
+    return tryOpenSegment(time(0));
+}
+
+bool RotatingFileLogAppender::tryOpenSegment(time_t now) {
+    if(openSegment(now)) {
+        if(m_retryTime) {
+            std::cout << "[INFO] RotatingFileLogAppender reopen " << m_filename << " ok" << std::endl;
+            m_retryTime = 0;
+        }
+        return true;
+    }
+    std::cout << "[ERROR] RotatingFileLogAppender open segment " << m_filename << " error: " << strerror(errno)
+              << ", retry in " << RETRY_INTERVAL << "s" << std::endl;
+    m_retryTime = now + RETRY_INTERVAL;
+    return false;
+}
+
+/**
+ * 已存在的段文件会接着写：正常关闭的段已经截断到实际长度，直接从文件末尾续写；
+ * 如果文件长度等于段大小（进程没有正常关闭，预分配的尾部全是0），就从后往前找到最后一个非0字节作为续写位置
+ *
+ * 映射之前必须用fallocate真正分配磁盘块：映射稀疏文件的话，磁盘满时写映射内存会触发SIGBUS杀掉进程。
+ * 文件系统不支持fallocate时不映射，改用pwrite写入，磁盘满时只是写失败；其他错误（如磁盘空间不足）直接放弃这个段
+ */
+bool RotatingFileLogAppender::openSegment(time_t now) {
+    m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(m_fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(m_fd, &st) == -1 || (size_t)st.st_size > m_maxSize) {
+        ::close(m_fd);
+        m_fd = -1;
+        shiftSegments();
+        m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(m_fd == -1) {
+            return false;
+        }
+        st.st_size = 0;
+    }
+
+    if(fallocate(m_fd, 0, 0, m_maxSize) == -1) {
+        if(errno != EOPNOTSUPP) {
+            int err = errno;
+            ::close(m_fd);
+            m_fd = -1;
+            errno = err;
+            return false;
+        }
+        m_offset = st.st_size;
+        m_openTime = now;
+        return true;
+    }
+
+    void *base = mmap(nullptr, m_maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(base == MAP_FAILED) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_base = (char *)base;
+    m_offset = st.st_size;
+    if(m_offset == m_maxSize) {
+        while(m_offset > 0 && m_base[m_offset - 1] == '\0') {
+            --m_offset;
+        }
+    }
+    m_openTime = now;
+    return true;
+}
+
+void RotatingFileLogAppender::closeSegment() {
+    if(m_base) {
+        munmap(m_base, m_maxSize);
+        m_base = nullptr;
+    }
+    if(m_fd != -1) {
+        if(ftruncate(m_fd, m_offset) == -1) {
+            std::cout << "[ERROR] RotatingFileLogAppender truncate " << m_filename << " error" << std::endl;
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_offset = 0;
+}
+
+void RotatingFileLogAppender::shiftSegments() {
+    if(m_retention == 0) {
+        unlink(m_filename.c_str());
+        return;
+    }
+    unlink((m_filename + "." + std::to_string(m_retention)).c_str());
+    for(size_t i = m_retention - 1; i > 0; i--) {
+        rename((m_filename + "." + std::to_string(i)).c_str()
+            , (m_filename + "." + std::to_string(i + 1)).c_str());
+    }
+    rename(m_filename.c_str(), (m_filename + ".1").c_str());
+}
+
+std::atomic<uint64_t> Logger::s_levelGeneration {1};
+
 Logger::Logger(const std::string &name)
     : m_name(name)
     , m_level(LogLevel::INFO)
+    , m_appenders(new std::vector<LogAppender::ptr>)
     , m_createTime(KSC::GetElapsedMS()) {
     }
 
+/**
+ * 修改appender列表都是拷贝一份当前快照，修改后整体发布，旧快照等正在写日志的线程离开后再释放
+ */
 void Logger::addAppender(LogAppender::ptr appender) {
-    KSC::spin_lock lock(m_mutex);
-    m_appenders.push_back(appender);
+    KSC::adaptive_lock lock(m_mutex);
+    auto appenders = new std::vector<LogAppender::ptr>(*m_appenders.load());
+    appenders->push_back(appender);
+    m_appenders.store(appenders);
 }
 
 void Logger::delAppender(LogAppender::ptr appender) {
-    KSC::spin_lock lock(m_mutex);
-    for(auto it = m_appenders.begin(); it != m_appenders.end(); it++) {
+    KSC::adaptive_lock lock(m_mutex);
+    auto appenders = new std::vector<LogAppender::ptr>(*m_appenders.load());
+    for(auto it = appenders->begin(); it != appenders->end(); it++) {
         if(*it == appender) {
-            m_appenders.erase(it);
+            appenders->erase(it);
             break;
         }
     }
+    m_appenders.store(appenders);
 }
 
 void Logger::clearAppenders() {
-    KSC::spin_lock lock(m_mutex);
-    m_appenders.clear();
+    KSC::adaptive_lock lock(m_mutex);
+    m_appenders.store(new std::vector<LogAppender::ptr>);
 }
 
 /**
@@ -475,8 +670,11 @@ void Logger::clearAppenders() {
  * Logger至少要有一个appender，否则没有输出
  */
 void Logger::log(LogEvent::ptr event) {
-    if(event->getLevel() <= m_level) {
-        for(auto &i : m_appenders) {
+    if(event->getLevel() <= getLevel()) {
+        // appender持有锁和RCU读临界区写文件，不能被hook交给阻塞线程池而挂起协程，写日志期间关掉hook
+        KSC::HookEnableGuard hook(false);
+        KSC::RcuReadGuard guard;
+        for(auto &i : *m_appenders.load()) {
             i->log(event);
         }
     }
@@ -497,7 +695,7 @@ LogEventWrap::~LogEventWrap() {
 LoggerManager::LoggerManager() {
     m_root.reset(new Logger("root"));
     m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
-    m_loggers[m_root->getName()] = m_root;
+    m_loggers.store(new std::map<std::string, Logger::ptr>{{m_root->getName(), m_root}});
     init();
 }
 
@@ -511,14 +709,25 @@ LoggerManager *LoggerManager::GetInstance() {
  * 需要手动添加Appender
  */
 Logger::ptr LoggerManager::getLogger(const std::string &name) {
-    KSC::spin_lock lock(m_mutex);
-    auto it = m_loggers.find(name);
-    if(it != m_loggers.end()) {
+    {
+        KSC::RcuReadGuard guard;
+        auto loggers = m_loggers.load();
+        auto it = loggers->find(name);
+        if(it != loggers->end()) {
+            return it->second;
+        }
+    }
+
+    KSC::adaptive_lock lock(m_mutex);
+    auto it = m_loggers.load()->find(name);
+    if(it != m_loggers.load()->end()) {
         return it->second;
     }
 
     Logger::ptr logger(new Logger(name));
-    m_loggers[name] = logger;
+    auto loggers = new std::map<std::string, Logger::ptr>(*m_loggers.load());
+    (*loggers)[name] = logger;
+    m_loggers.store(loggers);
     return logger;
 }
 
@@ -0,0 +1,106 @@
+#include "rcu.h"
+
+namespace KSC {
+
+static thread_local void *st_reader = nullptr; // 当前线程占用的读者槽位
+
+/**
+ * 线程退出时归还读者槽位，之后如果还有读操作（例如其他thread_local析构时写日志），会重新占用一个槽位
+ */
+struct ReaderReleaser {
+    std::atomic<bool> *inUse = nullptr;
+    ~ReaderReleaser() {
+        if (inUse) {
+            inUse->store(false, std::memory_order_release);
+        }
+        st_reader = nullptr;
+    }
+};
+
+static thread_local ReaderReleaser st_readerReleaser;
+
+// 回收域在进程退出时不析构，避免静态对象析构顺序导致退出阶段写日志时访问已销毁的回收域
+RcuDomain *RcuDomain::GetInstance() {
+    static RcuDomain *instance = new RcuDomain;
+    return instance;
+}
+
+RcuDomain::Reader *RcuDomain::getReader() {
+    if (st_reader) {
+        return (Reader *)st_reader;
+    }
+
+    Reader *reader = nullptr;
+    for (Reader *r = m_readers.load(std::memory_order_acquire); r; r = r->next) {
+        bool expected = false;
+        if (!r->inUse.load(std::memory_order_relaxed)
+                && r->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            reader = r;
+            break;
+        }
+    }
+
+    if (!reader) {
+        reader = new Reader;
+        reader->inUse.store(true, std::memory_order_relaxed);
+        Reader *head = m_readers.load(std::memory_order_relaxed);
+        do {
+            reader->next = head;
+        } while (!m_readers.compare_exchange_weak(head, reader, std::memory_order_release));
+    }
+
+    reader->depth = 0;
+    reader->epoch.store(0, std::memory_order_relaxed);
+    st_reader = reader;
+    st_readerReleaser.inUse = &reader->inUse;
+    return reader;
+}
+
+void RcuDomain::readLock() {
+    Reader *reader = getReader();
+    if (reader->depth++ == 0) {
+        reader->epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // 保证登记epoch先于后续对快照指针的读取，与retire中推进epoch后扫描读者的顺序相配合
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void RcuDomain::readUnlock() {
+    Reader *reader = (Reader *)st_reader;
+    if (--reader->depth == 0) {
+        reader->epoch.store(0, std::memory_order_release);
+    }
+}
+
+/**
+ * 读到旧快照的读者登记的epoch一定小于这里推进后的epoch，
+ * 所以当所有活跃读者的epoch都不小于它时，旧快照不会再被访问
+ */
+void RcuDomain::retire(void *ptr, void (*deleter)(void *)) {
+    uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::lock_guard<std::mutex> lck(m_retireMtx);
+    m_retired.push_back({ptr, deleter, epoch});
+    reclaim();
+}
+
+void RcuDomain::reclaim() {
+    uint64_t minEpoch = ~0ull;
+    for (Reader *r = m_readers.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t epoch = r->epoch.load(std::memory_order_seq_cst);
+        if (epoch && epoch < minEpoch) {
+            minEpoch = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); i++) {
+        if (m_retired[i].epoch <= minEpoch) {
+            m_retired[i].deleter(m_retired[i].ptr);
+        } else {
+            m_retired[kept++] = m_retired[i];
+        }
+    }
+    m_retired.resize(kept);
+}
+
+};
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 
 #include "scheduler.h"
 #include "hook.h"
@@ -8,12 +10,100 @@ namespace KSC {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
+static_assert(SchedulerStats::PRIORITY_CLASSES == Scheduler::PRIORITY_COUNT, "priority stats mismatch");
+
 static thread_local Scheduler *st_scheduler = nullptr; // 当前线程的调度器
 static thread_local Doroutine::ptr st_schedulerDoroutine = nullptr; // 当前线程的调度协程
 
-Scheduler::Scheduler(size_t threads, bool useCaller, const std::string &name) 
+// 工作线程私有的本地任务
+// runNext和ready平时只有本线程访问，本线程卡住时监控线程会把它们移到全局队列，所以这两个字段要加锁；其余字段只有本线程访问
+struct LocalQueue {
+    adaptive_mutex mtx;
+    std::atomic<size_t> size {0}; // runNext和ready中的协程数，本线程不加锁判断是否为空
+    Doroutine::ptr runNext; // LIFO槽位，最近一次被本线程上的任务唤醒的协程
+    std::deque<Doroutine::ptr> ready; // 本线程轮询到的I/O等待者
+    int streak = 0; // 连续执行本地任务的次数
+    bool idle = false; // 是否正在执行idle协程
+    uint64_t idleSinceMs = 0; // 从什么时候开始一直空闲，0表示刚执行过任务
+    bool retiring = false; // 弹性模式下已决定退出
+    // 正在迁往其他调度器的协程，让出后由调度循环放进目标调度器
+    Doroutine::ptr switching;
+    Scheduler *switchTarget = nullptr;
+    int switchThread = -1;
+
+    bool empty() const { return size.load(std::memory_order_relaxed) == 0; }
+
+    Doroutine::ptr pop() {
+        Doroutine::ptr d;
+        std::lock_guard<adaptive_mutex> lck(mtx);
+        if (runNext) {
+            d.swap(runNext);
+        } else if (!ready.empty()) {
+            d = std::move(ready.front());
+            ready.pop_front();
+        }
+        if (d) {
+            size.store(size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        return d;
+    }
+
+    bool pushReady(Doroutine::ptr d, size_t capacity) {
+        std::lock_guard<adaptive_mutex> lck(mtx);
+        if (ready.size() >= capacity) {
+            return false;
+        }
+        ready.push_back(std::move(d));
+        size.store(size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 放进LIFO槽位，返回被挤出的协程
+    Doroutine::ptr pushRunNext(Doroutine::ptr d) {
+        std::lock_guard<adaptive_mutex> lck(mtx);
+        Doroutine::ptr evicted = std::move(runNext);
+        runNext = std::move(d);
+        if (!evicted) {
+            size.store(size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        return evicted;
+    }
+
+    // 取走全部本地任务，runNext在前
+    void takeAll(std::vector<Doroutine::ptr> &out) {
+        std::lock_guard<adaptive_mutex> lck(mtx);
+        if (runNext) {
+            out.push_back(std::move(runNext));
+        }
+        for (auto &d : ready) {
+            out.push_back(std::move(d));
+        }
+        ready.clear();
+        size.store(0, std::memory_order_relaxed);
+    }
+};
+
+// 协程已经让出并保存好上下文，可以交给目标调度器了
+static void finishSwitch(LocalQueue &local) {
+    if (!local.switching) {
+        return;
+    }
+    Doroutine::ptr d = std::move(local.switching);
+    Scheduler *target = local.switchTarget;
+    local.switchTarget = nullptr;
+    target->schedule(d, local.switchThread);
+}
+
+static thread_local LocalQueue *st_local = nullptr; // 当前工作线程的本地任务
+thread_local Scheduler::WorkerProgress *Scheduler::st_progress = nullptr;
+static thread_local bool st_poolWorker = false; // 是否为线程池创建的工作线程，只有它们可以空闲退出
+static thread_local bool st_temporaryWorker = false; // 是否为监控线程临时增加的工作线程
+static thread_local bool st_retired = false; // 本线程是否已经申请退出
+
+Scheduler::Scheduler(size_t threads, bool useCaller, const std::string &name, const SchedulerOptions &options) 
     : m_useCaller(useCaller) 
-    , m_name(name) {
+    , m_name(name)
+    , m_options(options) {
 
     if (useCaller) {
         --threads;
@@ -28,6 +118,13 @@ Scheduler::Scheduler(size_t threads, bool useCaller, const std::string &name)
         m_rootThreadId = -1;
     }
     m_threadCount = threads;
+
+    size_t maxThreads = options.maxThreads;
+    if (useCaller && maxThreads > 0) {
+        --maxThreads;
+    }
+    m_elastic = maxThreads > m_threadCount;
+    m_maxThreadCount = std::max(maxThreads, m_threadCount);
 }
 
 Scheduler::~Scheduler() {
@@ -38,14 +135,23 @@ Scheduler::~Scheduler() {
 }
 
 void Scheduler::start() {
-    std::lock_guard<std::mutex> lck(m_mtx);
+    std::lock_guard<adaptive_mutex> lck(m_mtx);
     if (m_stopping) {
         SYLAR_LOG_DEBUG(g_logger) << "Scheduler is stopping";
         return;
     }
+    // 弹性模式下也只创建下限数量的线程，其余按负载增加
     m_threadPool.resize(m_threadCount);
     for (size_t i = 0; i < m_threadPool.size(); i++) {
-        m_threadPool[i] = new std::thread(std::bind(&Scheduler::run, this));
+        m_threadPool[i] = new std::thread([this, i]() {
+            runWorker(i, false);
+        });
+    }
+    m_nextWorkerIndex = m_threadCount;
+    m_stats.threads = m_stats.peakThreads = m_threadCount;
+
+    if ((m_options.stallThresholdMs > 0 || m_options.timeSliceMs > 0) && !m_monitor) {
+        m_monitor = new std::thread(std::bind(&Scheduler::monitor, this));
     }
 }
 
@@ -53,9 +159,14 @@ void Scheduler::stop() {
     if (stopping()) {
         return;
     }
-    m_stopping = true;
+    size_t threads = 0;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        m_stopping = true;
+        threads = m_threadPool.size();
+    }
 
-    for (size_t i = 0; i < m_threadCount; i++) {
+    for (size_t i = 0; i < threads; i++) {
         tickle();
     }
 
@@ -69,12 +180,23 @@ void Scheduler::stop() {
 
     std::vector<std::thread*> thrs;
     {
-        std::lock_guard<std::mutex> lck(m_mtx);
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
         thrs.swap(m_threadPool);
     }
     for (auto &i : thrs) {
         i->join();
     }
+
+    if (m_monitor) {
+        {
+            std::lock_guard<std::mutex> lck(m_monitorMtx);
+            m_monitorStop = true;
+        }
+        m_monitorCond.notify_one();
+        m_monitor->join();
+        delete m_monitor;
+        m_monitor = nullptr;
+    }
 }
 
 Scheduler *Scheduler::GetThis() {
@@ -94,85 +216,541 @@ void Scheduler::tickle() {
 
 void Scheduler::idle() {
     SYLAR_LOG_DEBUG(g_logger) << "idle";
-    while (!stopping()) {
+    while (!stopping() && !IsRetiring()) {
         Doroutine::GetThis()->yield();
     }
 }
 
 bool Scheduler::stopping() {
-    std::lock_guard<std::mutex> lck(m_mtx);
-    return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+    std::lock_guard<adaptive_mutex> lck(m_mtx);
+    return m_stopping && m_taskCount == 0 && m_activeThreadCount == 0 && m_externalWaits == 0;
+}
+
+bool Scheduler::scheduleLocal(Doroutine::ptr doroutine) {
+    if (st_scheduler != this || !st_local) {
+        return false;
+    }
+    return st_local->pushReady(std::move(doroutine), LOCAL_READY_CAPACITY);
+}
+
+bool Scheduler::scheduleRunNext(Doroutine::ptr &doroutine, int thread) {
+    // idle协程里的唤醒来自I/O和定时器，不属于任务之间的消息传递，仍走全局队列让空闲线程分担
+    if (st_scheduler != this || !st_local || st_local->idle || !doroutine
+        || (thread != -1 && thread != KSC::GetThreadId())) {
+        return false;
+    }
+    // 先放下本地队列的锁再加全局锁，监控线程是按相反的顺序加锁的
+    Doroutine::ptr evicted = st_local->pushRunNext(std::move(doroutine));
+    if (evicted) {
+        bool needTickle = false;
+        {
+            std::lock_guard<adaptive_mutex> lck(m_mtx);
+            needTickle = scheduleNoLock(evicted, -1);
+        }
+        if (needTickle) {
+            tickle();
+        }
+    }
+    return true;
 }
 
 void Scheduler::run() {
     setHookEnable(true);
+    // 同一个线程上可能先后构造了多个useCaller的调度器，构造时设置的线程变量会被后来者覆盖，这里按本调度器重新设置，退出时还原
+    Scheduler *prevScheduler = st_scheduler;
+    Doroutine::ptr prevSchedulerDoroutine = st_schedulerDoroutine;
     setThis();
     if (KSC::GetThreadId() != m_rootThreadId) {
         Doroutine::threadMainDoroutineInit();
         st_schedulerDoroutine = Doroutine::GetMainThis();
+    } else {
+        st_schedulerDoroutine = m_rootDoroutine;
     }
 
     Doroutine::ptr idleDoroutine = std::make_shared<Doroutine>(std::bind(&Scheduler::idle, this));
     Doroutine::ptr funcDoroutine;
+    LocalQueue local;
+    st_local = &local;
+
+    WorkerProgress::ptr progress;
+    if (m_options.stallThresholdMs > 0 || m_options.timeSliceMs > 0) {
+        progress = std::make_shared<WorkerProgress>();
+        progress->thread = KSC::GetThreadId();
+        st_progress = progress.get();
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        progress->local = &local;
+        m_workers.push_back(progress);
+    }
 
     SchedulerTask task;
     while (true) {
         task.reset();
         bool tickleMe = false;
+        if (local.streak < LOCAL_STREAK_LIMIT && !local.empty()) {
+            // 本地任务是本线程刚刚唤醒或轮询到的协程，直接在本线程恢复，保持缓存热度
+            Doroutine::ptr d = local.pop();
+            ++local.streak;
+            local.idleSinceMs = 0;
+            if (d->getState() == Doroutine::RUNNING) {
+                // 唤醒得太早，协程还没在别的线程上让出，交给全局队列等它让出后再调度
+                std::lock_guard<adaptive_mutex> lck(m_mtx);
+                scheduleNoLock(d, -1);
+                continue;
+            }
+            ++m_activeThreadCount;
+            if (progress) {
+                progress->begin(d->getId());
+            }
+            d->resume();
+            if (progress) {
+                progress->end();
+            }
+            --m_activeThreadCount;
+            finishSwitch(local);
+            continue;
+        }
+        local.streak = 0;
         {
-            std::lock_guard<std::mutex> lck(m_mtx);
-            auto it = m_tasks.begin();
-            while (it != m_tasks.end()) {
-                if (it->thread != -1 && it->thread != KSC::GetThreadId()) {
-                    // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-                    ++it;
-                    tickleMe = true;
-                    continue;
-                }
-
-                if(it->doroutine && it->doroutine->getState() == Doroutine::RUNNING) {
-                    ++it;
-                    continue;
-                }
-
-                task = *it;
-                m_tasks.erase(it++);
+            std::lock_guard<adaptive_mutex> lck(m_mtx);
+            if (dequeueNoLock(task, tickleMe)) {
                 ++m_activeThreadCount;
-                break;
+                // 取走一个任务后还有剩余，通知其他线程
+                tickleMe |= (m_taskCount > 0);
             }
-            tickleMe |= (it != m_tasks.end());
         }
 
         if (tickleMe) {
             tickle();
         }
+        if (task.doroutine || task.func) {
+            local.idleSinceMs = 0;
+            // 任务排队太久说明现有线程处理不过来
+            if (m_elastic && KSC::GetElapsedUS() - task.enqueueUs >= m_options.growWaitUs
+                && !hasIdleThreads()) {
+                grow();
+            }
+        }
 
         if (task.doroutine) {
+            if (progress) {
+                progress->begin(task.doroutine->getId());
+            }
             task.doroutine->resume();
+            if (progress) {
+                progress->end();
+            }
             --m_activeThreadCount;
             task.reset();
+            finishSwitch(local);
         } else if (task.func) {
             if (funcDoroutine) {
                 funcDoroutine->reset(task.func);
             } else {
                 funcDoroutine = std::make_shared<Doroutine>(task.func);
             }
+            // 函数任务挂起后被唤醒时沿用它的优先级
+            funcDoroutine->setPriority(task.priority);
             task.reset();
+            if (progress) {
+                progress->begin(funcDoroutine->getId());
+            }
             funcDoroutine->resume();
+            if (progress) {
+                progress->end();
+            }
             --m_activeThreadCount;
             funcDoroutine.reset();
+            finishSwitch(local);
+        } else if (!local.empty()) {
+            // 全局队列没有可执行的任务，本地任务不必再让
+            continue;
         } else {
             // 进到这个分支情况一定是任务队列空了，调度idle协程即可
             if (idleDoroutine->getState() == Doroutine::TERM) {
                 // 如果调度器没有调度任务，那么idle协程会不停地resume/yield，不会结束，如果idle协程结束了，那一定是调度器停止了
                 break;
             }
+            if (st_temporaryWorker && !local.retiring) {
+                // 临时线程只负责在有线程卡住时把积压的任务消化掉，没活了就退出
+                local.retiring = tryRetire(true);
+            } else if (m_elastic && st_poolWorker && !local.retiring) {
+                uint64_t now = KSC::GetElapsedMS();
+                if (!local.idleSinceMs) {
+                    local.idleSinceMs = now;
+                } else if (now - local.idleSinceMs >= m_options.retireIdleMs) {
+                    local.retiring = tryRetire(false);
+                }
+            }
             ++m_idleThreadCount;
             SYLAR_LOG_DEBUG(g_logger) << "idle resume";
+            local.idle = true;
             idleDoroutine->resume();
+            local.idle = false;
             --m_idleThreadCount;
         }
     }
+    st_local = nullptr;
+    st_progress = nullptr;
+    st_scheduler = prevScheduler;
+    st_schedulerDoroutine = prevSchedulerDoroutine;
+    if (progress) {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        progress->local = nullptr;
+        m_workers.erase(std::find(m_workers.begin(), m_workers.end(), progress));
+    }
+    // 其他线程可能在本线程还有活跃任务时检查过停止条件，然后回到epoll_wait里睡眠，退出前唤醒它们重新检查
+    tickle();
+}
+
+bool Scheduler::takeTaskNoLock(TaskList &tasks, SchedulerTask &task, bool &tickleMe) {
+    for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+        if (it->thread != -1 && it->thread != KSC::GetThreadId() && !isRetiredNoLock(it->thread)) {
+            // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
+            tickleMe = true;
+            continue;
+        }
+
+        if (it->doroutine && it->doroutine->getState() == Doroutine::RUNNING) {
+            continue;
+        }
+
+        task = std::move(*it);
+        tasks.erase(it);
+        --m_taskCount;
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::dequeueNoLock(SchedulerTask &task, bool &tickleMe) {
+    if (m_taskCount == 0) {
+        return false;
+    }
+    bool found = takeTaskNoLock(m_tasks[PRIORITY_HIGH], task, tickleMe);
+    if (!found) {
+        // 一轮normalWeight + lowWeight次出队里，有lowWeight次先看低优先级队列，优先的队列没有可执行任务时取另一个
+        uint32_t normalWeight = std::max<uint32_t>(1, m_options.normalWeight);
+        uint32_t round = normalWeight + m_options.lowWeight;
+        bool lowFirst = m_weightCursor >= normalWeight;
+        int first = lowFirst ? PRIORITY_LOW : PRIORITY_NORMAL;
+        int second = lowFirst ? PRIORITY_NORMAL : PRIORITY_LOW;
+        found = takeTaskNoLock(m_tasks[first], task, tickleMe) || takeTaskNoLock(m_tasks[second], task, tickleMe);
+        if (found) {
+            m_weightCursor = (m_weightCursor + 1) % round;
+        }
+    }
+    if (found) {
+        uint64_t now = KSC::GetElapsedUS();
+        uint64_t wait = now - task.enqueueUs;
+        ++m_stats.dequeued[task.priority];
+        m_stats.waitTotalUs[task.priority] += wait;
+        m_stats.waitMaxUs[task.priority] = std::max(m_stats.waitMaxUs[task.priority], wait);
+        if (m_options.codelTargetUs > 0) {
+            updateOverloadNoLock(wait, now);
+        }
+    }
+    return found;
+}
+
+/**
+ * CoDel的判断方式：只看排队时间是否持续高于目标，而不是队列长度。短时间的突发会很快被消化，
+ * 排队时间偶尔超过目标不算过载；整个间隔内取出的每个任务都等得比目标久，说明处理能力跟不上到达速度
+ */
+void Scheduler::updateOverloadNoLock(uint64_t sojournUs, uint64_t now) {
+    if (sojournUs < m_options.codelTargetUs || m_taskCount == 0) {
+        m_aboveTargetUntilUs = 0;
+        if (m_overloaded.load(std::memory_order_relaxed)) {
+            m_overloaded.store(false, std::memory_order_relaxed);
+            SYLAR_LOG_INFO(g_logger) << m_name << " leaves overload, queue wait " << sojournUs << "us";
+        }
+        return;
+    }
+    if (m_aboveTargetUntilUs == 0) {
+        m_aboveTargetUntilUs = now + m_options.codelIntervalUs;
+    } else if (now >= m_aboveTargetUntilUs && !m_overloaded.load(std::memory_order_relaxed)) {
+        m_overloaded.store(true, std::memory_order_relaxed);
+        ++m_stats.overloads;
+        SYLAR_LOG_WARN(g_logger) << m_name << " overloaded, queue wait " << sojournUs << "us";
+    }
+}
+
+bool Scheduler::SwitchTo(Scheduler *target, int thread) {
+    Doroutine::ptr cur = Doroutine::GetThis();
+    if (!target || !st_local || st_local->idle || !cur || cur.get() == GetMainDoroutine() || cur == Doroutine::GetMainThis()) {
+        return false;
+    }
+    // 不能在让出之前就放进目标队列：目标线程看到协程仍在运行会跳过它，之后可能一直睡在idle里
+    st_local->switching = cur;
+    st_local->switchTarget = target;
+    st_local->switchThread = thread;
+    cur->yield();
+    return true;
+}
+
+void Scheduler::bindWorker(size_t index) {
+    if (m_options.cpus.empty()) {
+        return;
+    }
+    int cpu = m_options.cpus[index % m_options.cpus.size()];
+    if (!KSC::SetThreadAffinity(cpu)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind worker " << index << " to cpu " << cpu << " failed";
+        return;
+    }
+    if (m_options.numaLocal) {
+        int node = KSC::GetCpuNumaNode(cpu);
+        if (node < 0 || !KSC::SetThreadPreferredNode(node)) {
+            SYLAR_LOG_ERROR(g_logger) << "set preferred numa node " << node << " for cpu " << cpu << " failed";
+        }
+    }
+}
+
+void Scheduler::runWorker(size_t index, bool temporary) {
+    bindWorker(index);
+    st_poolWorker = true;
+    st_temporaryWorker = temporary;
+    if (temporary) {
+        // 临时线程由监控线程创建，不改名的话会沿用监控线程的名字
+        KSC::SetThreadName(m_name.substr(0, 11) + "_tmp");
+    }
+    {
+        // 线程id可能被复用，新线程不能被当成已退出的线程
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        auto it = std::find(m_retiredThreadIds.begin(), m_retiredThreadIds.end(), KSC::GetThreadId());
+        if (it != m_retiredThreadIds.end()) {
+            m_retiredThreadIds.erase(it);
+        }
+    }
+    run();
+    if (st_retired) {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        m_exitedThreads.push_back(std::this_thread::get_id());
+    }
+}
+
+void Scheduler::spawnWorkerNoLock(bool temporary) {
+    size_t index = m_nextWorkerIndex++;
+    m_threadPool.push_back(new std::thread([this, index, temporary]() {
+        runWorker(index, temporary);
+    }));
+    ++m_stats.threads;
+    m_stats.peakThreads = std::max(m_stats.peakThreads, m_stats.threads);
+}
+
+void Scheduler::reapExitedNoLock(std::vector<std::thread*> &exited) {
+    for (auto it = m_threadPool.begin(); it != m_threadPool.end();) {
+        if (std::find(m_exitedThreads.begin(), m_exitedThreads.end(), (*it)->get_id()) != m_exitedThreads.end()) {
+            exited.push_back(*it);
+            it = m_threadPool.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_exitedThreads.clear();
+}
+
+void Scheduler::grow() {
+    std::vector<std::thread*> exited;
+    size_t threads = 0;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        uint64_t now = KSC::GetElapsedUS();
+        if (m_stopping || m_stats.threads >= m_maxThreadCount || now - m_lastGrowUs < m_options.growIntervalUs) {
+            return;
+        }
+        m_lastGrowUs = now;
+        // 顺便回收已经退出的线程
+        reapExitedNoLock(exited);
+        spawnWorkerNoLock(false);
+        ++m_stats.grows;
+        threads = m_stats.threads;
+    }
+    for (auto &t : exited) {
+        t->join();
+        delete t;
+    }
+    SYLAR_LOG_DEBUG(g_logger) << m_name << " grow to " << threads << " threads";
+}
+
+bool Scheduler::tryRetire(bool temporary) {
+    size_t threads = 0;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        if (m_stopping || (!temporary && m_stats.threads <= m_threadCount)) {
+            return false;
+        }
+        threads = --m_stats.threads;
+        if (temporary) {
+            --m_temporaryThreads;
+        } else {
+            ++m_stats.retires;
+        }
+        m_retiredThreadIds.push_back(KSC::GetThreadId());
+    }
+    st_retired = true;
+    SYLAR_LOG_DEBUG(g_logger) << m_name << " retire a worker, " << threads << " threads left";
+    return true;
+}
+
+bool Scheduler::PreemptRequested() {
+    return st_progress && st_progress->preempt.load(std::memory_order_relaxed);
+}
+
+bool Scheduler::RequeuePreempted(const Doroutine::ptr &doroutine, size_t &bucket) {
+    WorkerProgress *progress = st_progress;
+    Scheduler *sc = st_scheduler;
+    if (!progress || !sc || !doroutine || doroutine.get() == GetMainDoroutine() || doroutine == Doroutine::GetMainThis()) {
+        return false;
+    }
+    progress->preempt.store(false, std::memory_order_relaxed);
+    uint64_t overrun = KSC::GetElapsedUS() - progress->preemptAtUs.load(std::memory_order_relaxed);
+    bucket = 0;
+    while (overrun > 1 && bucket + 1 < SchedulerStats::OVERRUN_BUCKETS) {
+        overrun >>= 1;
+        ++bucket;
+    }
+
+    bool needTickle = false;
+    {
+        // 直接放到全局队列末尾，不进LIFO槽位，否则让出之后马上又轮到它
+        std::lock_guard<adaptive_mutex> lck(sc->m_mtx);
+        needTickle = sc->scheduleNoLock(doroutine, -1);
+        ++sc->m_stats.preemptions;
+        ++sc->m_stats.overrunHistogram[bucket];
+    }
+    if (needTickle) {
+        sc->tickle();
+    }
+    return true;
+}
+
+void Scheduler::monitor() {
+    KSC::SetThreadName(m_name.substr(0, 11) + "_mon");
+    // 卡住检查的周期取阈值的四分之一，时间片检查的周期取时间片的一半，两者都开启时取较小的
+    uint64_t periodMs = ~0ull;
+    if (m_options.stallThresholdMs > 0) {
+        periodMs = std::min(periodMs, m_options.stallThresholdMs / 4);
+    }
+    if (m_options.timeSliceMs > 0) {
+        periodMs = std::min(periodMs, m_options.timeSliceMs / 2);
+    }
+    auto period = std::chrono::milliseconds(std::max<uint64_t>(1, periodMs));
+    std::unique_lock<std::mutex> lck(m_monitorMtx);
+    while (!m_monitorCond.wait_for(lck, period, [this]() { return m_monitorStop; })) {
+        lck.unlock();
+        checkWorkers();
+        lck.lock();
+    }
+}
+
+/**
+ * 工作线程每开始执行一个任务进度加1，进度不变且仍在执行任务的时间就是当前协程连续运行的时间。
+ * 超过时间片时置位抢占标记，由协程在maybeYield检查点上让出；
+ * 超过卡住阈值说明卡在了某个协程里（未hook的阻塞调用或长时间计算），这个线程上的协程和只能由它执行的任务都得不到调度。
+ * 卡住的线程的runNext和ready里的协程（比如卡住的协程刚唤醒的）只有它自己会执行，每轮检查都把它们移到全局队列，让其他线程接手。
+ * 开启补偿时，如果全局队列还有任务而没有空闲线程，就临时增加工作线程，临时线程数不超过卡住的线程数
+ */
+void Scheduler::checkWorkers() {
+    uint64_t now = KSC::GetElapsedMS();
+    std::vector<WorkerProgress::ptr> workers;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        workers = m_workers;
+    }
+
+    size_t stalled = 0;
+    for (auto &w : workers) {
+        uint64_t running = w->running.load(std::memory_order_relaxed);
+        uint64_t ticks = w->ticks.load(std::memory_order_relaxed);
+        if (running == WorkerProgress::NONE || ticks != w->seenTicks) {
+            w->seenTicks = ticks;
+            w->seenSinceMs = now;
+            w->stalled = false;
+            continue;
+        }
+        if (m_options.timeSliceMs > 0 && now - w->seenSinceMs >= m_options.timeSliceMs
+            && !w->preempt.load(std::memory_order_relaxed)) {
+            w->preemptAtUs.store(KSC::GetElapsedUS(), std::memory_order_relaxed);
+            w->preempt.store(true, std::memory_order_release);
+        }
+        if (m_options.stallThresholdMs == 0 || now - w->seenSinceMs < m_options.stallThresholdMs) {
+            continue;
+        }
+        ++stalled;
+        if (!w->stalled) {
+            w->stalled = true;
+            SYLAR_LOG_ERROR(g_logger) << m_name << " worker " << w->thread << " stuck in doroutine " << running
+                                      << " for " << now - w->seenSinceMs << "ms";
+            std::lock_guard<adaptive_mutex> lck(m_mtx);
+            ++m_stats.stalls;
+        }
+        size_t moved = 0;
+        bool needTickle = false;
+        {
+            std::lock_guard<adaptive_mutex> lck(m_mtx);
+            needTickle = stealLocalNoLock(*w, moved);
+        }
+        if (moved) {
+            SYLAR_LOG_INFO(g_logger) << m_name << " move " << moved << " local task(s) of stuck worker " << w->thread
+                                     << " to the global queue";
+        }
+        if (needTickle) {
+            tickle();
+        }
+    }
+
+    size_t depth = 0;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        depth = m_taskCount;
+    }
+    if (!stalled || !m_options.compensateStall || depth == 0 || hasIdleThreads()) {
+        return;
+    }
+    std::vector<std::thread*> exited;
+    {
+        std::lock_guard<adaptive_mutex> lck(m_mtx);
+        if (m_stopping || m_temporaryThreads >= stalled) {
+            return;
+        }
+        reapExitedNoLock(exited);
+        spawnWorkerNoLock(true);
+        ++m_temporaryThreads;
+        ++m_stats.compensations;
+    }
+    for (auto &t : exited) {
+        t->join();
+        delete t;
+    }
+    SYLAR_LOG_INFO(g_logger) << m_name << " add a temporary worker for " << stalled << " stuck worker(s)";
+}
+
+bool Scheduler::stealLocalNoLock(WorkerProgress &worker, size_t &moved) {
+    // 线程退出前会在m_mtx下清空local，持有m_mtx时它一定还有效
+    if (!worker.local || worker.local->empty()) {
+        return false;
+    }
+    std::vector<Doroutine::ptr> stolen;
+    worker.local->takeAll(stolen);
+    bool needTickle = false;
+    for (auto &d : stolen) {
+        needTickle |= scheduleNoLock(d, -1);
+    }
+    moved = stolen.size();
+    return needTickle;
+}
+
+bool Scheduler::isRetiredNoLock(int thread) const {
+    return !m_retiredThreadIds.empty()
+        && std::find(m_retiredThreadIds.begin(), m_retiredThreadIds.end(), thread) != m_retiredThreadIds.end();
+}
+
+bool Scheduler::IsRetiring() {
+    return st_local && st_local->retiring;
+}
+
+SchedulerStats Scheduler::getStats() {
+    std::lock_guard<adaptive_mutex> lck(m_mtx);
+    return m_stats;
 }
 
 void Scheduler::setThis() {
@@ -0,0 +1,72 @@
+#include "strand.h"
+#include "mutex.h"
+#include "util.h"
+
+namespace KSC {
+
+Strand::Strand(Scheduler *scheduler)
+    : m_scheduler(scheduler) {
+    m_head = new Node; // 哨兵节点
+    m_tail.store((uintptr_t)m_head | IDLE, std::memory_order_relaxed);
+}
+
+Strand::~Strand() {
+    // 排空任务持有共享指针，能析构说明已经空闲，链表里只剩哨兵
+    delete m_head;
+}
+
+void Strand::post(std::function<void()> task) {
+    Node *node = new Node;
+    node->task = std::move(task);
+    uintptr_t prev = m_tail.exchange((uintptr_t)node, std::memory_order_acq_rel);
+    ((Node *)(prev & ~IDLE))->next.store(node, std::memory_order_release);
+    if (prev & IDLE) {
+        // 投递方就在上次执行它的线程上时固定到本线程，否则交给任意线程，避免排在一个忙碌线程后面
+        int last = m_lastThread.load(std::memory_order_relaxed);
+        scheduleDrain(last == KSC::GetThreadId() ? last : -1);
+    }
+}
+
+bool Strand::runningInThisStrand() const {
+    return m_owner.load(std::memory_order_relaxed) == Doroutine::GetThisId();
+}
+
+void Strand::scheduleDrain(int thread) {
+    Strand::ptr self = shared_from_this();
+    m_scheduler->schedule(std::function<void()>([self]() {
+        self->drain();
+    }), thread);
+}
+
+void Strand::drain() {
+    m_lastThread.store(KSC::GetThreadId(), std::memory_order_relaxed);
+    m_owner.store(Doroutine::GetThisId(), std::memory_order_relaxed);
+
+    for (int i = 0; i < BATCH; i++) {
+        Node *head = m_head;
+        Node *next = head->next.load(std::memory_order_acquire);
+        if (!next) {
+            uintptr_t expected = (uintptr_t)head;
+            m_owner.store(~0ull, std::memory_order_relaxed);
+            if (m_tail.compare_exchange_strong(expected, (uintptr_t)head | IDLE, std::memory_order_acq_rel)) {
+                return;
+            }
+            m_owner.store(Doroutine::GetThisId(), std::memory_order_relaxed);
+            // 有生产者已经换走了尾指针但还没来得及链接，很快就会出现
+            while (!(next = head->next.load(std::memory_order_acquire))) {
+                cpu_relax();
+            }
+        }
+        m_head = next;
+        delete head;
+        std::function<void()> task = std::move(next->task);
+        next->task = nullptr;
+        task();
+    }
+
+    m_owner.store(~0ull, std::memory_order_relaxed);
+    // 一批执行完仍有剩余，让出线程给其他任务，并在本线程上继续
+    scheduleDrain(KSC::GetThreadId());
+}
+
+};
@@ -99,7 +99,7 @@ TimerManager::~TimerManager() {
 }
 
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> func, bool repeat) {
-    Timer::ptr timer(new Timer(ms, func, repeat, this));
+    Timer::ptr timer = MakePooledShared(new Timer(ms, func, repeat, this));
     writeMtx lck(m_rwMtx);
     addTimer(timer, lck);
     return timer;
@@ -148,7 +148,7 @@ void TimerManager::listExpiredFunc(std::vector<std::function<void()>> &funcs) {
         return;
     }
 
-    Timer::ptr now_timer(new Timer(nowInMs));
+    Timer::ptr now_timer = MakePooledShared(new Timer(nowInMs));
     auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
     while(it != m_timers.end() && (*it)->m_next == nowInMs) {
         ++it;
@@ -1,14 +1,25 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <linux/mempolicy.h>
 
 #include "util.h"
 #include "doroutine.h"
 
 namespace KSC {
 
+// 线程id在线程生命周期内不变，缓存下来避免每次调度都做一次系统调用
 pid_t GetThreadId(){
-    return syscall(SYS_gettid);
+    static thread_local pid_t t_threadId = 0;
+    if (!t_threadId) {
+        t_threadId = syscall(SYS_gettid);
+    }
+    return t_threadId;
 }
 
 std::string GetThreadName() {
@@ -31,5 +42,49 @@ uint64_t GetElapsedMS() {
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t GetElapsedUS() {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool SetThreadAffinity(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// /sys/devices/system/cpu/cpuN/目录下有一个nodeM的链接指向所在节点
+int GetCpuNumaNode(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent *ent = readdir(dir)) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// 不依赖libnuma，直接走set_mempolicy系统调用
+bool SetThreadPreferredNode(int node) {
+    const int bits = sizeof(unsigned long) * 8;
+    if (node < 0 || node >= bits * 16) {
+        return false;
+    }
+    unsigned long mask[16] = {0};
+    mask[node / bits] = 1UL << (node % bits);
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)(sizeof(mask) * 8)) == 0;
+}
 
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "blockingPool.h"
+#include "iomanager.h"
+#include "taskGroup.h"
+#include "hook.h"
+#include "util.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 演示offload：8个协程各自执行一次阻塞100ms的调用，只有一个工作线程，总耗时仍然接近100ms
+ */
+void testOffload() {
+    KSC::TaskGroup<int> group;
+    uint64_t begin = KSC::GetElapsedMS();
+    for (int i = 0; i < 8; i++) {
+        group.spawn([i] {
+            // 阻塞线程池里没有开启hook，usleep会真正阻塞那个线程
+            return KSC::offload([i] {
+                usleep(100 * 1000);
+                return i;
+            });
+        });
+    }
+    group.wait();
+    int sum = 0;
+    for (auto &outcome : group.results()) {
+        sum += *outcome.value;
+    }
+    SYLAR_LOG_INFO(g_logger) << "8 offloaded sleeps of 100ms took " << KSC::GetElapsedMS() - begin << "ms, sum = " << sum;
+
+    try {
+        KSC::offload([]() -> int {
+            throw std::runtime_error("offload error");
+        });
+    } catch (const std::exception &e) {
+        SYLAR_LOG_INFO(g_logger) << "caught: " << e.what();
+    }
+}
+
+/**
+ * @brief 演示hook后的普通文件读写：open/write/fsync/pread都在阻塞线程池里执行
+ */
+void testFileIo() {
+    const char *path = "testBlockingPool.tmp";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        SYLAR_LOG_INFO(g_logger) << "open failed, errno = " << errno;
+        return;
+    }
+    const std::string data = "hello blocking pool";
+    ssize_t n = write(fd, data.data(), data.size());
+    int rt = fsync(fd);
+    char buf[64] = {0};
+    ssize_t m = pread(fd, buf, sizeof(buf) - 1, 0);
+    SYLAR_LOG_INFO(g_logger) << "write = " << n << ", fsync = " << rt << ", pread = " << m << ", content = " << buf;
+
+    n = read(-1, buf, sizeof(buf));
+    SYLAR_LOG_INFO(g_logger) << "read bad fd = " << n << ", errno = " << strerror(errno);
+    close(fd);
+    unlink(path);
+
+    KSC::BlockingPool *pool = KSC::BlockingPool::GetInstance();
+    SYLAR_LOG_INFO(g_logger) << "pool threads = " << pool->threadCount() << ", busy = " << pool->busyCount()
+                             << ", queue depth = " << pool->queueDepth() << ", completed = " << pool->completed();
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(1);
+    iom.schedule(testOffload);
+    iom.schedule(testFileIo);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "channel.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int COUNT = 1000;
+
+/**
+ * @brief 演示有界通道：多个生产者发送，一个消费者接收，全部发送完后关闭通道
+ */
+void testBounded() {
+    auto ch = std::make_shared<KSC::Channel<int>>(8);
+    auto done = std::make_shared<KSC::Channel<int>>(KSC::Channel<int>::UNBOUNDED);
+    const int producers = 4;
+
+    for (int p = 0; p < producers; p++) {
+        KSC::IOManager::GetThis()->schedule([ch, done] {
+            for (int i = 1; i <= COUNT; i++) {
+                ch->send(i);
+            }
+            done->send(1);
+        });
+    }
+
+    KSC::IOManager::GetThis()->schedule([ch, done] {
+        int finished = 0;
+        int one;
+        while (finished < producers && done->recv(one)) {
+            finished += one;
+        }
+        ch->close();
+    });
+
+    long sum = 0;
+    int val;
+    while (ch->recv(val)) {
+        sum += val;
+    }
+    SYLAR_LOG_INFO(g_logger) << "bounded sum = " << sum << ", expected " << (long)producers * COUNT * (COUNT + 1) / 2;
+    SYLAR_LOG_INFO(g_logger) << "send after close = " << ch->send(0);
+}
+
+/**
+ * @brief 演示无缓冲通道传递只能移动的对象，以及批量收发
+ */
+void testMoveOnlyAndBatch() {
+    auto ch = std::make_shared<KSC::Channel<std::unique_ptr<std::string>>>();
+    KSC::IOManager::GetThis()->schedule([ch] {
+        ch->send(std::make_unique<std::string>("hello channel"));
+    });
+    std::unique_ptr<std::string> msg;
+    ch->recv(msg);
+    SYLAR_LOG_INFO(g_logger) << "move only recv: " << *msg;
+
+    auto batch = std::make_shared<KSC::Channel<int>>(16);
+    KSC::IOManager::GetThis()->schedule([batch] {
+        int vals[100];
+        for (int i = 0; i < 100; i++) {
+            vals[i] = i;
+        }
+        size_t sent = batch->sendN(vals, 100);
+        SYLAR_LOG_INFO(g_logger) << "sendN sent " << sent;
+        batch->close();
+    });
+    int buf[32];
+    size_t total = 0;
+    size_t got;
+    while ((got = batch->recvN(buf, 32)) > 0) {
+        total += got;
+    }
+    SYLAR_LOG_INFO(g_logger) << "recvN total = " << total << ", expected 100";
+}
+
+/**
+ * @brief 演示select：等待两个通道中先到的一个，以及超时
+ */
+void testSelect() {
+    auto a = std::make_shared<KSC::Channel<int>>();
+    auto b = std::make_shared<KSC::Channel<std::string>>();
+
+    int x = 0;
+    std::string s;
+    int idx = KSC::select(100, a->onRecv(x), b->onRecv(s));
+    SYLAR_LOG_INFO(g_logger) << "select with nothing ready returns " << idx << ", expected -1";
+
+    KSC::IOManager::GetThis()->addTimer(50, [b] {
+        b->send("from b");
+    });
+    idx = KSC::select(1000, a->onRecv(x), b->onRecv(s));
+    SYLAR_LOG_INFO(g_logger) << "select returns " << idx << ", value " << s;
+
+    bool ok = true;
+    a->close();
+    idx = KSC::select(KSC::SELECT_WAIT_FOREVER, a->onRecv(x, &ok), b->onRecv(s));
+    SYLAR_LOG_INFO(g_logger) << "select on closed channel returns " << idx << ", ok = " << ok;
+}
+
+/**
+ * @brief 演示开启LIFO槽位后的ping-pong：被唤醒的协程在唤醒方让出后直接在同一线程上运行
+ */
+void testRunNext() {
+    auto ping = std::make_shared<KSC::Channel<int>>();
+    auto pong = std::make_shared<KSC::Channel<int>>();
+    {
+        KSC::IOManager iom(2, false, "runNext");
+        iom.setRunNext(true);
+        iom.schedule([ping, pong] {
+            int val;
+            while (ping->recv(val)) {
+                pong->send(val + 1);
+            }
+        });
+        iom.schedule([ping, pong] {
+            int val = 0;
+            for (int i = 0; i < COUNT; i++) {
+                ping->send(val);
+                pong->recv(val);
+            }
+            SYLAR_LOG_INFO(g_logger) << "run next ping-pong val = " << val << ", expected " << COUNT;
+            ping->close();
+        });
+    }
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    {
+        KSC::IOManager iom(2);
+        iom.schedule(testBounded);
+        iom.schedule(testMoveOnlyAndBatch);
+        iom.schedule(testSelect);
+    }
+    testRunNext();
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <deque>
+#include <atomic>
+
+#include "scheduler.h"
+#include "doroutineSync.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 让出当前协程，稍后由调度器重新调度，用来制造持锁期间的切换
+ */
+static void yieldNow() {
+    KSC::Scheduler::GetThis()->schedule(KSC::Doroutine::GetThis());
+    KSC::Doroutine::GetThis()->yield();
+}
+
+static const int TASKS = 50;
+static const int LOOPS = 1000;
+
+static KSC::DoroutineMutex s_mutex;
+static int s_counter = 0;
+
+/**
+ * @brief 演示互斥锁：持锁期间yield，其他协程竞争时挂起而不是阻塞工作线程
+ */
+void testMutex() {
+    for (int i = 0; i < LOOPS; i++) {
+        KSC::DoroutineMutexLock lck(s_mutex);
+        int old = s_counter;
+        if (i % 100 == 0) {
+            yieldNow();
+        }
+        s_counter = old + 1;
+    }
+}
+
+static const int CAPACITY = 4;
+static KSC::DoroutineSemaphore s_empty(CAPACITY);
+static KSC::DoroutineSemaphore s_full(0);
+static KSC::DoroutineMutex s_queueMutex;
+static std::deque<int> s_queue;
+static std::atomic<long> s_consumed {0};
+
+/**
+ * @brief 演示信号量：有界缓冲区上的生产者消费者
+ */
+void producer() {
+    for (int i = 1; i <= LOOPS; i++) {
+        s_empty.wait();
+        {
+            KSC::DoroutineMutexLock lck(s_queueMutex);
+            s_queue.push_back(i);
+        }
+        s_full.notify();
+    }
+}
+
+void consumer() {
+    for (int i = 0; i < LOOPS; i++) {
+        s_full.wait();
+        int val;
+        {
+            KSC::DoroutineMutexLock lck(s_queueMutex);
+            val = s_queue.front();
+            s_queue.pop_front();
+        }
+        s_empty.notify();
+        s_consumed += val;
+    }
+}
+
+static KSC::DoroutineMutex s_cvMutex;
+static KSC::DoroutineConditionVariable s_cv;
+static bool s_ready = false;
+static std::atomic<int> s_woken {0};
+
+/**
+ * @brief 演示条件变量：所有等待者在s_ready置位后被一次唤醒
+ */
+void waiter() {
+    KSC::DoroutineMutexLock lck(s_cvMutex);
+    s_cv.wait(s_cvMutex, [] { return s_ready; });
+    ++s_woken;
+}
+
+void notifier() {
+    yieldNow(); // 尽量让等待者先挂起
+    KSC::DoroutineMutexLock lck(s_cvMutex);
+    s_ready = true;
+    s_cv.notifyAll();
+}
+
+static KSC::DoroutineRWMutex s_rwMutex;
+static long s_a = 0;
+static long s_b = 0;
+static std::atomic<bool> s_torn {false};
+
+/**
+ * @brief 演示读写锁：写者在两次写之间yield，读者不应看到只写了一半的数据
+ */
+void rwWriter() {
+    for (int i = 0; i < LOOPS / 10; i++) {
+        KSC::DoroutineWriteLock lck(s_rwMutex);
+        ++s_a;
+        yieldNow();
+        ++s_b;
+    }
+}
+
+void rwReader() {
+    for (int i = 0; i < LOOPS / 10; i++) {
+        KSC::DoroutineReadLock lck(s_rwMutex);
+        if (s_a != s_b) {
+            s_torn = true;
+        }
+        if (i % 10 == 0) {
+            yieldNow();
+        }
+    }
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+
+    KSC::Scheduler sc(4, false);
+    sc.start();
+
+    for (int i = 0; i < TASKS; i++) {
+        sc.schedule(testMutex);
+    }
+    for (int i = 0; i < TASKS / 10; i++) {
+        sc.schedule(producer);
+        sc.schedule(consumer);
+    }
+    for (int i = 0; i < TASKS; i++) {
+        sc.schedule(waiter);
+    }
+    sc.schedule(notifier);
+    for (int i = 0; i < TASKS / 10; i++) {
+        sc.schedule(rwWriter);
+        sc.schedule(rwReader);
+        sc.schedule(rwReader);
+    }
+
+    // 普通线程也可以使用协程锁，竞争时退化为futex睡眠
+    for (int i = 0; i < LOOPS; i++) {
+        KSC::DoroutineMutexLock lck(s_mutex);
+        s_counter++;
+    }
+
+    sc.stop();
+
+    long expected = (long)TASKS / 10 * LOOPS * (LOOPS + 1) / 2;
+    SYLAR_LOG_INFO(g_logger) << "mutex counter = " << s_counter << ", expected " << (TASKS + 1) * LOOPS;
+    SYLAR_LOG_INFO(g_logger) << "semaphore consumed = " << s_consumed << ", expected " << expected;
+    SYLAR_LOG_INFO(g_logger) << "condition variable woken = " << s_woken << ", expected " << TASKS;
+    SYLAR_LOG_INFO(g_logger) << "rwmutex a = " << s_a << ", b = " << s_b << ", torn = " << s_torn;
+    SYLAR_LOG_INFO(g_logger) << "main end";
+    return 0;
+}
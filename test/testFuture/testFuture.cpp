@@ -0,0 +1,72 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "iomanager.h"
+#include "future.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 演示Promise/Future：等待方挂起，完成方设置结果后等待方被重新调度
+ */
+void testPromise() {
+    auto promise = std::make_shared<KSC::Promise<std::string>>();
+    KSC::Future<std::string> future = promise->getFuture();
+
+    // 多个协程等待同一个结果
+    for (int i = 0; i < 3; i++) {
+        KSC::IOManager::GetThis()->schedule([future, i] {
+            SYLAR_LOG_INFO(g_logger) << "waiter " << i << " got: " << future.get();
+        });
+    }
+
+    KSC::IOManager::GetThis()->addTimer(50, [promise] {
+        promise->setValue("hello future");
+    });
+    SYLAR_LOG_INFO(g_logger) << "main waiter got: " << future.get();
+}
+
+/**
+ * @brief 演示submit和then：异常沿着then链传递
+ */
+void testThen() {
+    KSC::Future<int> f = KSC::submit(KSC::IOManager::GetThis(), [] {
+        usleep(10 * 1000);
+        return 20;
+    });
+    KSC::Future<std::string> g = f.then([](const int &v) { return v + 1; })
+                                  .then([](const int &v) { return std::to_string(v * 2); });
+    SYLAR_LOG_INFO(g_logger) << "then chain = " << g.get() << ", expected 42";
+
+    KSC::Future<void> bad = KSC::submit(KSC::IOManager::GetThis(), [] {
+        throw std::runtime_error("task failed");
+    });
+    KSC::Future<int> after = bad.then([] { return 1; });
+    try {
+        after.get();
+    } catch (const std::exception &e) {
+        SYLAR_LOG_INFO(g_logger) << "exception propagated: " << e.what();
+    }
+
+    KSC::Future<int> broken;
+    {
+        KSC::Promise<int> p;
+        broken = p.getFuture();
+    }
+    try {
+        broken.get();
+    } catch (const std::future_error &e) {
+        SYLAR_LOG_INFO(g_logger) << "broken promise: " << e.what();
+    }
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(2);
+    iom.schedule(testPromise);
+    iom.schedule(testThen);
+    return 0;
+}
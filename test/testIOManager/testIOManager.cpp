@@ -8,6 +8,8 @@
 #include <chrono>
 
 #include "iomanager.h"
+#include "hook.h"
+#include "util.h"
 #include "forTest.h"
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
@@ -104,8 +106,95 @@ void test_iomanager() {
     iom.schedule(test_io);
 }
 
+/**
+ * @brief 演示弹性线程池：任务阻塞导致队列积压时扩容，负载消失后多出来的线程空闲退出
+ */
+void test_elastic() {
+    // 主线程刚作为useCaller线程跑过调度器，hook仍然开着，这里的usleep要真正睡眠
+    KSC::setHookEnable(false);
+    KSC::SchedulerOptions options;
+    options.maxThreads = 4;
+    options.growQueueDepth = 4;
+    options.retireIdleMs = 200;
+    KSC::IOManager iom(1, false, "elastic", options);
+
+    for (int i = 0; i < 32; i++) {
+        iom.schedule([] {
+            // 关掉hook模拟真正阻塞线程的任务
+            KSC::setHookEnable(false);
+            usleep(10 * 1000);
+            KSC::setHookEnable(true);
+        });
+    }
+    usleep(50 * 1000);
+    KSC::SchedulerStats stats = iom.getStats();
+    SYLAR_LOG_INFO(g_logger) << "under load: threads = " << stats.threads << ", peak = " << stats.peakThreads
+                             << ", grows = " << stats.grows;
+
+    usleep(1000 * 1000);
+    stats = iom.getStats();
+    SYLAR_LOG_INFO(g_logger) << "after quiet period: threads = " << stats.threads << ", retires = " << stats.retires;
+}
+
+/**
+ * @brief 演示卡住检测：唯一的工作线程被一个未hook的阻塞调用卡住，监控线程报告并临时增加线程执行排队的任务
+ */
+void test_stall() {
+    KSC::setHookEnable(false);
+    KSC::SchedulerOptions options;
+    options.stallThresholdMs = 100;
+    options.compensateStall = true;
+    KSC::IOManager iom(1, false, "stall", options);
+
+    uint64_t begin = KSC::GetElapsedMS();
+    iom.schedule([] {
+        KSC::setHookEnable(false);
+        usleep(500 * 1000);
+        KSC::setHookEnable(true);
+    });
+    usleep(10 * 1000);
+    for (int i = 0; i < 3; i++) {
+        iom.schedule([i, begin] {
+            SYLAR_LOG_INFO(g_logger) << "queued task " << i << " runs after " << KSC::GetElapsedMS() - begin << "ms";
+        });
+    }
+    usleep(700 * 1000);
+    KSC::SchedulerStats stats = iom.getStats();
+    SYLAR_LOG_INFO(g_logger) << "stalls = " << stats.stalls << ", compensations = " << stats.compensations
+                             << ", threads = " << stats.threads;
+}
+
+/**
+ * @brief 演示卡住线程的本地任务被移走：A通过LIFO槽位唤醒B之后卡住，B不在全局队列里，由监控线程移出后在临时线程上执行
+ */
+void test_stall_run_next() {
+    KSC::setHookEnable(false);
+    KSC::SchedulerOptions options;
+    options.stallThresholdMs = 100;
+    options.compensateStall = true;
+    KSC::IOManager iom(1, false, "stallRunNext", options);
+    iom.setRunNext(true);
+
+    uint64_t begin = KSC::GetElapsedMS();
+    iom.schedule([&iom, begin] {
+        KSC::Doroutine::ptr b = std::make_shared<KSC::Doroutine>([begin] {
+            SYLAR_LOG_INFO(g_logger) << "B woken through run-next runs after " << KSC::GetElapsedMS() - begin << "ms";
+        });
+        iom.schedule(b);
+        KSC::setHookEnable(false);
+        usleep(500 * 1000);
+        KSC::setHookEnable(true);
+    });
+    usleep(700 * 1000);
+    KSC::SchedulerStats stats = iom.getStats();
+    SYLAR_LOG_INFO(g_logger) << "stalls = " << stats.stalls << ", compensations = " << stats.compensations;
+}
+
 int main(int argc, char *argv[]) {
     // KSC::setLogLevelDebug();
     test_iomanager();
+    test_elastic();
+    test_stall();
+    test_stall_run_next();
     return 0;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <thread>
 #include <chrono>
+#include <vector>
 
 #include "log.h"
+#include "iomanager.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -42,5 +44,55 @@ int main() {
 
     SYLAR_LOG_ERROR(test_logger) << "err msg";
     SYLAR_LOG_INFO(test_logger) << "info msg"; // 不打印
+
+    // 段大小对齐到一页，写满后滚动为rotate.txt.1、rotate.txt.2，只保留2个历史段
+    sylar::Logger::ptr rotate_logger = SYLAR_LOG_NAME("rotate_logger");
+    sylar::RotatingFileLogAppender::ptr rotateAppender(new sylar::RotatingFileLogAppender("./rotate.txt", 4096, 0, 2));
+    rotate_logger->addAppender(rotateAppender);
+    for(int i = 0; i < 200; i++) {
+        SYLAR_LOG_INFO(rotate_logger) << "rotate msg " << i;
+    }
+    rotateAppender->requestReopen();
+    SYLAR_LOG_INFO(rotate_logger) << "after reopen";
+
+    // 在协程里滚动：持锁期间的open不能被hook交给阻塞线程池而挂起协程，否则同一工作线程上的下一条日志会在锁上卡住整个线程
+    {
+        KSC::IOManager iom(1, false, "rotate");
+        iom.schedule([rotateAppender] { rotateAppender->rotate(); });
+        iom.schedule([rotate_logger] { SYLAR_LOG_INFO(rotate_logger) << "after rotate in doroutine"; });
+    }
+
+    // 采样日志，被丢弃的条数在下一条输出的日志开头报告
+    for(int i = 0; i < 10; i++) {
+        SYLAR_LOG_EVERY_N(g_logger, sylar::LogLevel::ERROR, 4) << "every 4, i = " << i; // 打印i = 0, 4, 8
+        SYLAR_LOG_FIRST_N(g_logger, sylar::LogLevel::ERROR, 2) << "first 2, i = " << i; // 打印i = 0, 1
+    }
+    auto rateLimited = [](int i) {
+        SYLAR_LOG_RATE_LIMITED(g_logger, sylar::LogLevel::ERROR, 1, 3) << "rate limited, i = " << i;
+    };
+    for(int i = 0; i < 100; i++) {
+        rateLimited(i); // 打印i = 0, 1, 2
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    rateLimited(100); // 打印[suppressed 97] rate limited, i = 100
+
+    // 多线程写日志的同时反复增删appender，写日志的线程读的是appender列表快照，不会和修改冲突
+    sylar::Logger::ptr rcu_logger = SYLAR_LOG_NAME("rcu_logger");
+    sylar::LogAppender::ptr rcuAppender(new sylar::FileLogAppender("./rcu.txt"));
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; t++) {
+        threads.emplace_back([t] {
+            for(int i = 0; i < 10000; i++) {
+                SYLAR_LOG_INFO(SYLAR_LOG_NAME("rcu_logger")) << "thread " << t << " msg " << i;
+            }
+        });
+    }
+    for(int i = 0; i < 1000; i++) {
+        rcu_logger->addAppender(rcuAppender);
+        rcu_logger->delAppender(rcuAppender);
+    }
+    for(auto &t : threads) {
+        t.join();
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+#include "iomanager.h"
+#include "parallel.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 演示parallelFor：调用方协程和工作线程一起按块处理数组，调用方在等待其他块期间只挂起自己
+ */
+void testParallelFor() {
+    std::vector<int> data(100000);
+    KSC::parallelFor<size_t>(0, data.size(), 1000, [&data](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            data[i] = (int)(i % 7);
+        }
+    });
+    long long sum = 0;
+    for (int v : data) {
+        sum += v;
+    }
+    SYLAR_LOG_INFO(g_logger) << "parallelFor sum = " << sum;
+}
+
+/**
+ * @brief 演示parallelReduce：每块求和，最后合并
+ */
+void testParallelReduce() {
+    long long sum = KSC::parallelReduce<long long, long long>(1, 1000001, 4096, 0,
+        [](long long lo, long long hi) {
+            long long s = 0;
+            for (long long i = lo; i < hi; i++) {
+                s += i;
+            }
+            return s;
+        },
+        [](long long a, long long b) { return a + b; });
+    SYLAR_LOG_INFO(g_logger) << "parallelReduce sum = " << sum << ", expected = " << 1000000LL * 1000001 / 2;
+}
+
+/**
+ * @brief 演示异常传播：某一块抛出异常后，剩余的块不再执行，异常在全部块结束后抛给调用方
+ */
+void testParallelError() {
+    try {
+        KSC::parallelFor(0, 100, 1, [](int lo, int hi) {
+            if (lo == 42) {
+                throw std::runtime_error("chunk 42 failed");
+            }
+        });
+    } catch (const std::exception &e) {
+        SYLAR_LOG_INFO(g_logger) << "parallelFor error: " << e.what();
+    }
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(3);
+    iom.schedule(testParallelFor);
+    iom.schedule(testParallelReduce);
+    iom.schedule(testParallelError);
+    return 0;
+}
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory_resource>
 
 #include "scheduler.h"
+#include "doroutineLocal.h"
 #include "util.h"
 #include "hook.h"
 #include "forTest.h"
@@ -70,6 +75,216 @@ void testDoroutine4() {
     SYLAR_LOG_INFO(g_logger) << "testDoroutine4 end";
 }
 
+/**
+ * @brief 演示时间片抢占：一个工作线程上两个计算密集的协程，在检查点上按10ms的时间片轮流执行
+ */
+void testPreempt() {
+    KSC::SchedulerOptions options;
+    options.timeSliceMs = 10;
+    KSC::Scheduler sc(1, false, "preempt", options);
+    sc.start();
+
+    for (int i = 0; i < 2; i++) {
+        sc.schedule([i] {
+            KSC::setHookEnable(false);
+            uint64_t begin = KSC::GetElapsedMS();
+            uint64_t slices = 0;
+            volatile uint64_t sum = 0;
+            while (KSC::GetElapsedMS() - begin < 100) {
+                for (int j = 0; j < 1000; j++) {
+                    sum += j;
+                }
+                slices += KSC::Doroutine::maybeYield();
+            }
+            KSC::Doroutine::ptr cur = KSC::Doroutine::GetThis();
+            SYLAR_LOG_INFO(g_logger) << "cpu task " << i << " yielded " << slices << " times, preempt count = "
+                                     << cur->getPreemptCount();
+            for (size_t b = 0; b < KSC::Doroutine::OVERRUN_BUCKETS; b++) {
+                if (cur->getOverrunCount(b)) {
+                    SYLAR_LOG_INFO(g_logger) << "cpu task " << i << " overrun < " << (2ull << b) << "us: "
+                                             << cur->getOverrunCount(b);
+                }
+            }
+        });
+    }
+    sc.stop();
+
+    KSC::SchedulerStats stats = sc.getStats();
+    SYLAR_LOG_INFO(g_logger) << "preemptions = " << stats.preemptions;
+    for (size_t i = 0; i < KSC::SchedulerStats::OVERRUN_BUCKETS; i++) {
+        if (stats.overrunHistogram[i]) {
+            SYLAR_LOG_INFO(g_logger) << "overrun < " << (2ull << i) << "us: " << stats.overrunHistogram[i];
+        }
+    }
+}
+
+/**
+ * @brief 演示优先级：启动前先排入后台、普通和高优先级任务，单个工作线程上高优先级先执行，
+ * 普通和低优先级之间按4:1的权重交替，后台任务不会等到所有普通任务执行完
+ */
+void testPriority() {
+    KSC::Scheduler sc(1, false, "priority");
+    std::string order;
+    for (int i = 0; i < 5; i++) {
+        sc.schedule([&order] { order += 'L'; }, -1, KSC::Scheduler::PRIORITY_LOW);
+    }
+    for (int i = 0; i < 10; i++) {
+        sc.schedule([&order] { order += 'N'; });
+    }
+    for (int i = 0; i < 2; i++) {
+        sc.schedule([&order] { order += 'H'; }, -1, KSC::Scheduler::PRIORITY_HIGH);
+    }
+    sc.start();
+    sc.stop();
+
+    SYLAR_LOG_INFO(g_logger) << "priority order: " << order;
+    KSC::SchedulerStats stats = sc.getStats();
+    const char *names[] = {"high", "normal", "low"};
+    for (size_t i = 0; i < KSC::SchedulerStats::PRIORITY_CLASSES; i++) {
+        SYLAR_LOG_INFO(g_logger) << names[i] << ": dequeued = " << stats.dequeued[i]
+                                 << ", avg wait = " << (stats.dequeued[i] ? stats.waitTotalUs[i] / stats.dequeued[i] : 0)
+                                 << "us, max wait = " << stats.waitMaxUs[i] << "us";
+    }
+}
+
+/**
+ * @brief 演示过载检测：单个工作线程上堆积大量1ms的计算任务，排队时间持续超过目标后进入过载，
+ * 之后trySchedule提交的低优先级任务被拒绝，普通任务照常接受
+ */
+void testAdmission() {
+    KSC::setHookEnable(false);
+    KSC::SchedulerOptions options;
+    options.codelTargetUs = 2000;
+    options.codelIntervalUs = 10000;
+    KSC::Scheduler sc(1, false, "admission", options);
+    auto busy = [] {
+        uint64_t begin = KSC::GetElapsedUS();
+        while (KSC::GetElapsedUS() - begin < 1000);
+    };
+    for (int i = 0; i < 100; i++) {
+        sc.schedule(busy);
+    }
+    sc.start();
+
+    int accepted = 0, rejected = 0;
+    for (int i = 0; i < 50; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (sc.trySchedule([] {}, -1, KSC::Scheduler::PRIORITY_LOW)) {
+            ++accepted;
+        } else {
+            ++rejected;
+        }
+    }
+    bool normal = sc.trySchedule([] {});
+    sc.stop();
+
+    KSC::SchedulerStats stats = sc.getStats();
+    SYLAR_LOG_INFO(g_logger) << "low priority accepted = " << accepted << ", rejected = " << rejected
+                             << ", normal accepted = " << normal << ", overloads = " << stats.overloads
+                             << ", shed = " << stats.shed;
+}
+
+/**
+ * @brief 演示协程在两个调度器之间迁移：在io调度器上开始，切到cpu调度器计算，再切回来，始终是同一个协程
+ */
+void testSwitchTo() {
+    KSC::Scheduler io(1, false, "io");
+    KSC::Scheduler cpu(2, false, "cpu");
+    io.start();
+    cpu.start();
+
+    std::atomic<int> done {0};
+    for (int i = 0; i < 3; i++) {
+        io.schedule([&io, &cpu, &done, i] {
+            uint64_t id = KSC::Doroutine::GetThisId();
+            SYLAR_LOG_INFO(g_logger) << "task " << i << " doroutine " << id << " starts on " << KSC::Scheduler::GetThis()->getName();
+            KSC::Scheduler::SwitchTo(&cpu);
+            volatile uint64_t sum = 0;
+            for (int j = 0; j < 1000000; j++) {
+                sum += j;
+            }
+            SYLAR_LOG_INFO(g_logger) << "task " << i << " doroutine " << KSC::Doroutine::GetThisId() << " computes on "
+                                     << KSC::Scheduler::GetThis()->getName();
+            KSC::Scheduler::SwitchTo(&io);
+            SYLAR_LOG_INFO(g_logger) << "task " << i << " doroutine " << KSC::Doroutine::GetThisId() << " back on "
+                                     << KSC::Scheduler::GetThis()->getName();
+            ++done;
+        });
+    }
+    // 协程迁出期间原调度器不会等它，所以等全部回来之后再停止
+    while (done < 3) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    io.stop();
+    cpu.stop();
+}
+
+struct TraceContext {
+    uint64_t traceId = 0;
+    ~TraceContext() {
+        SYLAR_LOG_INFO(g_logger) << "trace " << traceId << " released in doroutine " << KSC::Doroutine::GetThisId();
+    }
+};
+
+static KSC::DoroutineLocal<TraceContext> s_trace;
+static KSC::DoroutineLocal<int> s_extra[10]; // 超过内嵌槽位数，后面几个落在堆表里
+
+/**
+ * @brief 演示协程局部变量：每个协程记录自己的trace id，迁移到其他调度器的线程上后仍能读到，协程结束时析构
+ */
+void testDoroutineLocal() {
+    KSC::Scheduler a(1, false, "local_a");
+    KSC::Scheduler b(1, false, "local_b");
+    a.start();
+    b.start();
+    std::atomic<int> done {0};
+    for (int i = 0; i < 3; i++) {
+        a.schedule([&b, &done, i] {
+            s_trace->traceId = 1000 + i;
+            for (int k = 0; k < 10; k++) {
+                s_extra[k].set(i * 10 + k);
+            }
+            int thread = KSC::GetThreadId();
+            KSC::Scheduler::SwitchTo(&b);
+            int sum = 0;
+            for (int k = 0; k < 10; k++) {
+                sum += *s_extra[k];
+            }
+            SYLAR_LOG_INFO(g_logger) << "trace " << s_trace->traceId << " moved from thread " << thread << " to "
+                                     << KSC::GetThreadId() << ", extra sum = " << sum;
+            ++done;
+        });
+    }
+    while (done < 3) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    a.stop();
+    b.stop();
+}
+
+/**
+ * @brief 演示协程的请求级分配器：任务里的临时字符串和数组都从当前协程的分配器分配，不逐个释放，
+ * 任务结束时整块归还，下一个复用同一个任务协程的任务从头开始
+ */
+void testArena() {
+    KSC::Scheduler sc(1, false, "arena");
+    sc.start();
+    for (int round = 0; round < 2; round++) {
+        sc.schedule([round] {
+            KSC::DoroutineArena &arena = KSC::Doroutine::GetThis()->getArena();
+            SYLAR_LOG_INFO(g_logger) << "round " << round << " starts with " << arena.allocated() << " bytes allocated";
+            std::pmr::memory_resource *mr = KSC::Doroutine::CurrentArena();
+            std::pmr::vector<std::pmr::string> headers(mr);
+            for (int i = 0; i < 200; i++) {
+                headers.emplace_back("x-request-header-" + std::to_string(i) + ": some reasonably long value");
+            }
+            SYLAR_LOG_INFO(g_logger) << "round " << round << " built " << headers.size() << " headers, arena allocated "
+                                     << arena.allocated() << " bytes in " << arena.heapChunks() << " heap chunks";
+        });
+    }
+    sc.stop();
+}
+
 int main() {
     // KSC::setLogLevelDebug();
     SYLAR_LOG_INFO(g_logger) << "main begin";
@@ -105,6 +320,13 @@ int main() {
      * 如果使用了当前线程进行调度，那么要先执行当前线程的协程调度函数，等其执行完后再返回caller协程继续往下执行
      */
     sc.stop();
+
+    testPreempt();
+    testPriority();
+    testAdmission();
+    testSwitchTo();
+    testDoroutineLocal();
+    testArena();
     SYLAR_LOG_INFO(g_logger) << "main end";
     return 0;
 }
\ No newline at end of file
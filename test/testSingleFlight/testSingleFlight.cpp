@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <unistd.h>
+
+#include "iomanager.h"
+#include "ttlCache.h"
+#include "doroutineSync.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_backendCalls {0};
+
+// 模拟一次耗时20毫秒的后端调用
+static std::string backend(const std::string &key) {
+    ++s_backendCalls;
+    usleep(20 * 1000);
+    return "value of " + key;
+}
+
+/**
+ * @brief 并发请求同一个热点key，整个TTL周期内只回源一次，过期后再回源一次
+ */
+void testHotKey() {
+    auto cache = std::make_shared<KSC::TtlCache<std::string, std::string>>(200, KSC::IOManager::GetThis());
+    const int callers = 200;
+
+    for (int round = 0; round < 2; round++) {
+        auto wg = std::make_shared<KSC::WaitGroup>(callers);
+        auto wrong = std::make_shared<std::atomic<int>>(0);
+        for (int i = 0; i < callers; i++) {
+            KSC::IOManager::GetThis()->schedule([cache, wg, wrong] {
+                if (cache->getOrLoad("hot", backend) != "value of hot") {
+                    ++*wrong;
+                }
+                wg->done();
+            });
+        }
+        wg->wait();
+        SYLAR_LOG_INFO(g_logger) << "round " << round << ": backend calls = " << s_backendCalls
+                                 << ", wrong results = " << *wrong << ", cache size = " << cache->size();
+        usleep(300 * 1000); // 等待条目过期
+        SYLAR_LOG_INFO(g_logger) << "after ttl cache size = " << cache->size();
+    }
+}
+
+/**
+ * @brief 直接使用SingleFlight：并发调用共享结果和异常
+ */
+void testSingleFlight() {
+    auto flight = std::make_shared<KSC::SingleFlight<int, int>>();
+    auto shared = std::make_shared<std::atomic<int>>(0);
+    auto wg = std::make_shared<KSC::WaitGroup>(10);
+    for (int i = 0; i < 10; i++) {
+        KSC::IOManager::GetThis()->schedule([flight, shared, wg] {
+            bool isShared = false;
+            try {
+                flight->call(1, []() -> int {
+                    usleep(10 * 1000);
+                    throw std::runtime_error("backend down");
+                }, &isShared);
+            } catch (const std::exception &e) {
+                *shared += isShared;
+            }
+            wg->done();
+        });
+    }
+    wg->wait();
+    SYLAR_LOG_INFO(g_logger) << "single flight shared callers = " << *shared << " of 10, inflight = " << flight->inflight();
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(2);
+    iom.schedule(testHotKey);
+    iom.schedule(testSingleFlight);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <vector>
+
+#include "iomanager.h"
+#include "strand.h"
+#include "doroutineSync.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int PRODUCERS = 8;
+static const int POSTS = 10000;
+
+// 只在Strand里访问，不需要加锁
+static long s_counter = 0;
+static std::vector<int> s_lastSeen(PRODUCERS, -1);
+static bool s_outOfOrder = false;
+static bool s_concurrent = false;
+static int s_inside = 0;
+
+/**
+ * @brief 演示Strand：多个协程并发投递，任务逐个按投递顺序执行，共享状态不需要加锁
+ */
+void testStrand() {
+    auto strand = std::make_shared<KSC::Strand>();
+    auto wg = std::make_shared<KSC::WaitGroup>(PRODUCERS * POSTS);
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        KSC::IOManager::GetThis()->schedule([strand, wg, p] {
+            for (int i = 0; i < POSTS; i++) {
+                strand->post([strand, wg, p, i] {
+                    if (++s_inside != 1) {
+                        s_concurrent = true;
+                    }
+                    if (!strand->runningInThisStrand()) {
+                        s_concurrent = true;
+                    }
+                    // 同一个生产者投递的任务必须按顺序执行
+                    if (s_lastSeen[p] != i - 1) {
+                        s_outOfOrder = true;
+                    }
+                    s_lastSeen[p] = i;
+                    ++s_counter;
+                    --s_inside;
+                    wg->done();
+                });
+            }
+        });
+    }
+
+    wg->wait();
+    SYLAR_LOG_INFO(g_logger) << "strand counter = " << s_counter << ", expected " << PRODUCERS * POSTS
+                             << ", out of order = " << s_outOfOrder << ", concurrent = " << s_concurrent
+                             << ", in strand here = " << strand->runningInThisStrand();
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(3);
+    iom.schedule(testStrand);
+    return 0;
+}
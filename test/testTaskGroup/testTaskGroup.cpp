@@ -0,0 +1,82 @@
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "iomanager.h"
+#include "taskGroup.h"
+#include "hook.h"
+#include "forTest.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 演示TaskGroup：父协程分发子任务后挂起，等全部完成后按spawn顺序读取结果和异常
+ */
+void testTaskGroup() {
+    KSC::TaskGroup<int> group;
+    for (int i = 0; i < 10; i++) {
+        group.spawn([i] {
+            usleep(1000 * (10 - i)); // 已hook，只挂起子协程
+            if (i == 7) {
+                throw std::runtime_error("task 7 failed");
+            }
+            return i * i;
+        });
+    }
+    group.wait();
+
+    int sum = 0;
+    for (const auto &outcome : group.results()) {
+        if (outcome.value) {
+            sum += *outcome.value;
+        }
+    }
+    SYLAR_LOG_INFO(g_logger) << "task group sum = " << sum << ", expected " << 285 - 49;
+    try {
+        group.rethrowFirstError();
+    } catch (const std::exception &e) {
+        SYLAR_LOG_INFO(g_logger) << "first error: " << e.what();
+    }
+}
+
+/**
+ * @brief 演示带超时的等待：慢任务超过截止时间后父协程先返回，只读取已经完成的结果
+ */
+void testDeadline() {
+    KSC::TaskGroup<void> group;
+    group.spawn([] { usleep(10 * 1000); });
+    group.spawn([] { usleep(500 * 1000); });
+    bool allDone = group.waitFor(100);
+    size_t ready = 0;
+    for (const auto &outcome : group.results()) {
+        ready += outcome.ready.load();
+    }
+    SYLAR_LOG_INFO(g_logger) << "waitFor(100) = " << allDone << ", ready " << ready << "/" << group.size()
+                             << ", pending " << group.pending();
+}
+
+/**
+ * @brief 演示WaitGroup：手动计数，子任务完成时不加锁
+ */
+void testWaitGroup() {
+    auto wg = std::make_shared<KSC::WaitGroup>();
+    auto total = std::make_shared<std::atomic<int>>(0);
+    for (int i = 0; i < 100; i++) {
+        wg->add();
+        KSC::IOManager::GetThis()->schedule([wg, total] {
+            ++*total;
+            wg->done();
+        });
+    }
+    wg->wait();
+    SYLAR_LOG_INFO(g_logger) << "wait group total = " << *total << ", expected 100";
+}
+
+int main() {
+    SYLAR_LOG_INFO(g_logger) << "main begin";
+    KSC::IOManager iom(2);
+    iom.schedule(testTaskGroup);
+    iom.schedule(testDeadline);
+    iom.schedule(testWaitGroup);
+    return 0;
+}